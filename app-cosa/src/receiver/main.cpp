@@ -1,4 +1,5 @@
 #include <Cosa/MCP2515.h>
+#include <Cosa/MCP2515Receiver.h>
 #include <Cosa/UART.hh>
 #include <Cosa/Trace.hh>
 #include <MCP2515.h>
@@ -6,8 +7,10 @@
 using namespace wlp;
 
 static cosa::MCP2515 base;
-static MCP2515 bus(&base);
-static uint8_t buf[8];
+static BasicMCP2515<cosa::MCP2515> bus(&base);
+// INT wired to D2
+static cosa::Receiver<16> receiver(Board::EXT0, &base, &bus);
+static CanFrame frame;
 
 void setup() {
     uart.begin(9600);
@@ -15,20 +18,20 @@ void setup() {
     while (bus.begin(CAN_500KBPS, MCP_16MHz) != Result::OK) {
         delay(100);
     }
+    receiver.begin();
     trace << "Receiver started" << endl;
 }
 
 void loop() {
-    if (bus.get_message_status() == MessageState::MessagePending) {
-        auto state = bus.read_buffer(8, buf);
-        if (state == MessageState::MessageFetched) {
-            trace << "Data from " << bus.get_id() << endl;
-            for (int i = 0; i < 8; ++i) {
-                trace << buf[i] << " ";
-            }
-            trace << endl;
-        } else {
-            trace << "Data read failed with state: " << state << endl;
+    while (receiver.read_frame(&frame) == MessageState::MessageFetched) {
+        trace << "Data from " << frame.id << endl;
+        for (int i = 0; i < frame.dlc; ++i) {
+            trace << frame.data[i] << " ";
         }
+        trace << endl;
+    }
+    if (receiver.dropped() || receiver.overruns()) {
+        trace << "Lost " << receiver.dropped() << " in ring, "
+              << receiver.overruns() << " on chip" << endl;
     }
 }
@@ -6,8 +6,9 @@
 using namespace wlp;
 
 static cosa::MCP2515 base;
-static MCP2515 bus(&base);
-static uint8_t buf[8];
+// Bound to the Cosa backend, SPI transfers are called without the vtable
+static BasicMCP2515<cosa::MCP2515> bus(&base);
+static CanFrame frame = {0x15, 0, 8, {0}};
 
 void setup() {
     uart.begin(9600);
@@ -19,9 +20,9 @@ void setup() {
 }
 
 void loop() {
-    bus.send_buffer(0x15, sizeof(buf), buf);
+    bus.send_frame(&frame);
     int i = 7;
-    while (i >= 0 && !++buf[i]) {
+    while (i >= 0 && !++frame.data[i]) {
         --i;
     }
     delay(250);
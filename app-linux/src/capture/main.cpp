@@ -0,0 +1,65 @@
+#include <sys/mcp2515.h>
+#include <sys/mcp2515_receiver.h>
+#include <sys/mcp2515_capture.h>
+#include <MCP2515.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+
+using namespace wlp;
+
+static volatile sig_atomic_t s_stop = 0;
+
+static void on_signal(int) {
+    s_stop = 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "capture.bin";
+    linux::MCP2515 base("/dev/spidev0.0", 10000000);
+    base.begin();
+    MCP2515 bus(&base);
+    while (bus.begin(CAN_500KBPS, MCP_8MHz) != Result::OK) {
+        printf("CAN init failed, retrying\n");
+        sleep(1);
+    }
+
+    static linux::GpioInterrupt interrupt;
+    if (interrupt.open("/dev/gpiochip0", 25) == 0) {
+        base.set_interrupt_source(&interrupt);
+    } else {
+        base.setup_interrupt(25);
+    }
+
+    // about two seconds of a full 1 Mbps bus in each ring
+    static CanFrame frames[16384];
+    static FrameInfo info[16384];
+    static linux::CaptureRecord records[16384];
+    linux::Receiver receiver(&base, &bus, frames, 16384, info);
+    linux::CaptureWriter writer(records, 16384);
+    if (writer.open(path) != 0) {
+        printf("Failed to open %s\n", path);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    receiver.start();
+    printf("Capturing to %s\n", path);
+
+    CanFrame frame;
+    FrameInfo frameInfo;
+    while (!s_stop) {
+        while (receiver.pop(&frame, &frameInfo)) {
+            writer.push(&frame, &frameInfo);
+        }
+        usleep(1000);
+    }
+    receiver.stop();
+    while (receiver.pop(&frame, &frameInfo)) {
+        writer.push(&frame, &frameInfo);
+    }
+    writer.close();
+    printf("%llu frames written, %u dropped by the receiver, %u by the writer, %u overruns\n",
+           (unsigned long long) writer.written(),
+           receiver.dropped(), writer.dropped(), receiver.overruns());
+}
@@ -15,18 +15,22 @@ int main(void) {
     }
     printf("CAN inited\n");
 
-    base.setup_interrupt(25);
+    static linux::GpioInterrupt interrupt;
+    if (interrupt.open("/dev/gpiochip0", 25) == 0) {
+        base.set_interrupt_source(&interrupt);
+    } else {
+        base.setup_interrupt(25);
+    }
 
-    uint8_t buf[8];
+    CanFrame frames[2];
     while (true) {
         base.wait_interrupt(500);
-        while (bus.get_message_status() == MessageState::MessagePending) {
-            auto state = bus.read_buffer(8, buf);
-
-            if (state == MessageState::MessageFetched) {
-                printf("Data from %d\n", bus.get_id());
-                for (int i = 0; i < 8; ++i) {
-                    printf("%02x ", buf[i]);
+        uint8_t n;
+        while ((n = bus.read_frames(frames, 2)) > 0) {
+            for (uint8_t i = 0; i < n; ++i) {
+                printf("Data from %d\n", frames[i].id);
+                for (int j = 0; j < frames[i].dlc; ++j) {
+                    printf("%02x ", frames[i].data[j]);
                 }
                 printf("\n");
             }
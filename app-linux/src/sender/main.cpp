@@ -15,12 +15,12 @@ int main(void) {
     }
     printf("CAN inited\n");
 
-    uint8_t buf[8];
+    CanFrame frame = {0x15, 0, 8, {0}};
     while (true) {
-        bus.send_buffer(0x15, sizeof(buf), buf);
+        bus.send_frame(&frame);
         sleep(0.5);
         int i = 7;
-        while (i >= 0 && !++buf[i]) {
+        while (i >= 0 && !++frame.data[i]) {
             --i;
         }
     }
@@ -7,15 +7,141 @@ namespace wlp {
 
     namespace Instruction {
         enum {
-            Fetch      = 0x00,
-            Write      = 0x02,
-            Read       = 0x03,
-            Modify     = 0x05,
-            ReadStatus = 0xA0,
-            Reset      = 0xC0
+            Fetch         = 0x00,
+            Write         = 0x02,
+            Read          = 0x03,
+            Modify        = 0x05,
+            LoadTX        = 0x40,
+            RequestToSend = 0x80,
+            ReadRX        = 0x90,
+            ReadStatus    = 0xA0,
+            Reset         = 0xC0
         };
     }
 
+    // A single SPI instruction: up to four header bytes followed by an
+    // optional payload that is either written from tx or read into rx.
+    struct Command {
+        uint8_t header[4];
+        uint8_t headerLength;
+        uint8_t length;
+        uint8_t *tx;
+        uint8_t *rx;
+    };
+
+    // Sequence of instructions submitted together through
+    // MCP2515Base::execute. Chip-select is released between commands.
+    class CommandList {
+    public:
+        CommandList(Command commands[], uint8_t capacity) :
+            m_commands(commands),
+            m_capacity(capacity),
+            m_size(0) {}
+
+        bool reset(void) {
+            return push(Instruction::Reset, 0, 0, 0, 1, 0, nullptr, nullptr);
+        }
+        bool read_status(uint8_t *status) {
+            return push(Instruction::ReadStatus, 0, 0, 0, 1, 1, nullptr, status);
+        }
+        bool read(uint8_t address, uint8_t values[], uint8_t n) {
+            return push(Instruction::Read, address, 0, 0, 2, n, nullptr, values);
+        }
+        bool set(uint8_t address, uint8_t value) {
+            return push(Instruction::Write, address, value, 0, 3, 0, nullptr, nullptr);
+        }
+        bool write(uint8_t address, uint8_t values[], uint8_t n) {
+            return push(Instruction::Write, address, 0, 0, 2, n, values, nullptr);
+        }
+        bool modify(uint8_t address, uint8_t mask, uint8_t data) {
+            return push(Instruction::Modify, address, mask, data, 4, 0, nullptr, nullptr);
+        }
+        bool read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+            return push(instruction, 0, 0, 0, 1, n, nullptr, values);
+        }
+        bool load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+            return push(instruction, 0, 0, 0, 1, n, values, nullptr);
+        }
+        bool request_to_send(uint8_t instruction) {
+            return push(instruction, 0, 0, 0, 1, 0, nullptr, nullptr);
+        }
+
+        void clear(void) { m_size = 0; }
+        uint8_t size(void) const { return m_size; }
+        Command &operator[](uint8_t i) { return m_commands[i]; }
+
+    private:
+        bool push(
+                uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3,
+                uint8_t headerLength, uint8_t length,
+                uint8_t *tx, uint8_t *rx) {
+            if (m_size >= m_capacity) {
+                return false;
+            }
+            Command &cmd = m_commands[m_size++];
+            cmd.header[0] = b0;
+            cmd.header[1] = b1;
+            cmd.header[2] = b2;
+            cmd.header[3] = b3;
+            cmd.headerLength = headerLength;
+            cmd.length = length;
+            cmd.tx = tx;
+            cmd.rx = rx;
+            return true;
+        }
+
+        Command *m_commands;
+        uint8_t m_capacity;
+        uint8_t m_size;
+    };
+
+    template<uint8_t N>
+    class CommandBuffer : public CommandList {
+    public:
+        CommandBuffer() : CommandList(m_storage, N) {}
+
+    private:
+        Command m_storage[N];
+    };
+
+    // Issue the commands one by one through the backend's own methods,
+    // inside one bus session. Backends declared final can override
+    // execute() with this to get direct, inlinable calls instead of
+    // virtual ones.
+    template<typename Backend>
+    void run_commands(Backend &backend, CommandList &list) {
+        backend.begin_session();
+        for (uint8_t i = 0; i < list.size(); ++i) {
+            Command &cmd = list[i];
+            uint8_t ins = cmd.header[0];
+            if (Instruction::Reset == ins) {
+                backend.reset();
+            } else if (Instruction::ReadStatus == ins) {
+                uint8_t status = backend.read_status();
+                for (uint8_t j = 0; j < cmd.length; ++j) {
+                    cmd.rx[j] = status;
+                }
+            } else if (Instruction::Read == ins) {
+                backend.read_registers(cmd.header[1], cmd.rx, cmd.length);
+            } else if (Instruction::Write == ins) {
+                if (cmd.headerLength > 2) {
+                    backend.set_register(cmd.header[1], cmd.header[2]);
+                } else {
+                    backend.set_registers(cmd.header[1], cmd.tx, cmd.length);
+                }
+            } else if (Instruction::Modify == ins) {
+                backend.modify_register(cmd.header[1], cmd.header[2], cmd.header[3]);
+            } else if (Instruction::ReadRX == (ins & 0xF9)) {
+                backend.read_rx_buffer(ins, cmd.rx, cmd.length);
+            } else if (Instruction::LoadTX == (ins & 0xF8)) {
+                backend.load_tx_buffer(ins, cmd.tx, cmd.length);
+            } else if (Instruction::RequestToSend == (ins & 0xF8)) {
+                backend.request_to_send(ins);
+            }
+        }
+        backend.end_session();
+    }
+
     class MCP2515Base {
     public:
         virtual void reset(void) = 0;
@@ -25,8 +151,128 @@ namespace wlp {
         virtual void set_register(uint8_t address, uint8_t value) = 0;
         virtual void set_registers(uint8_t address, uint8_t values[], uint8_t n) = 0;
         virtual void modify_register(uint8_t address, uint8_t mask, uint8_t data) = 0;
+
+        // Frame fast path. Backends should override these to issue the
+        // READ RX BUFFER, LOAD TX BUFFER and RTS instructions in a single
+        // chip-select cycle; the defaults fall back to register access.
+        //
+        // read_rx_buffer reads n bytes starting at the buffer selected by
+        // the instruction and leaves the matching RXnIF flag cleared.
+        virtual void read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n);
+        virtual void load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n);
+        virtual void request_to_send(uint8_t instruction);
+
+        // Run every command in the list. Backends that can submit several
+        // chip-select cycles at once should override this; the default
+        // issues the commands one by one.
+        virtual void execute(CommandList &list);
+
+        // Monotonic time in ns for the frame about to be read from RX
+        // buffer rxBuf: when the chip received it if the backend knows,
+        // the INT edge that announced it if the backend captured one,
+        // otherwise the current time. Called for each buffer of a read
+        // before the buffers are read. 0 when the backend has no clock.
+        virtual uint64_t receive_time(uint8_t) { return 0; }
+        // Monotonic time in ns on the same clock, used for transmit
+        // deadlines. 0 when the backend has no clock.
+        virtual uint64_t now(void) { return 0; }
+
+        // Hold the bus across several instructions, chip-select is still
+        // toggled per instruction. Sessions nest; backends whose bus
+        // needs no arbitration keep the no-op defaults.
+        virtual void begin_session(void) {}
+        virtual void end_session(void) {}
+
+    protected:
+        enum {
+            InterruptFlagRegister = 0x2C,
+            TXB0CTRL = 0x30,
+            TXB0SIDH = 0x31,
+            RXB0SIDH = 0x61,
+            BufferStride = 0x10,
+            DataOffset = 0x05,
+            RequestInProcess = 0x08
+        };
+    };
+
+    // Bus session for the lifetime of the object
+    template<typename Backend>
+    class BusSession {
+    public:
+        explicit BusSession(Backend *backend) : m_backend(backend) {
+            m_backend->begin_session();
+        }
+        ~BusSession() {
+            m_backend->end_session();
+        }
+
+    private:
+        BusSession(const BusSession &) = delete;
+        BusSession &operator=(const BusSession &) = delete;
+
+        Backend *m_backend;
+    };
+
+    // Widens a free-running 32-bit counter, such as a micros() that wraps
+    // every 71.6 min, to 64 bits by counting its wraps. It has to be
+    // sampled at least once per wrap, and callers that can race, like an
+    // interrupt handler and the main loop, must not call it concurrently.
+    class WideCounter {
+    public:
+        WideCounter() : m_high(0), m_last(0) {}
+
+        uint64_t extend(uint32_t count) {
+            if (count < m_last) {
+                ++m_high;
+            }
+            m_last = count;
+            return ((uint64_t) m_high << 32) | count;
+        }
+
+    private:
+        uint32_t m_high;
+        uint32_t m_last;
     };
 
+    inline void MCP2515Base::read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+        // 1001 0nm0: n selects RXB0/RXB1, m starts at D0 instead of SIDH
+        uint8_t rxb = (instruction >> 2) & 0x01;
+        uint8_t address = RXB0SIDH + rxb * BufferStride;
+        if (instruction & 0x02) {
+            address += DataOffset;
+        }
+        begin_session();
+        read_registers(address, values, n);
+        modify_register(InterruptFlagRegister, 0x01 << rxb, 0x00);
+        end_session();
+    }
+
+    inline void MCP2515Base::load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+        // 0100 0abc: ab selects TXB0-TXB2, c starts at D0 instead of SIDH
+        uint8_t txb = (instruction >> 1) & 0x03;
+        uint8_t address = TXB0SIDH + txb * BufferStride;
+        if (instruction & 0x01) {
+            address += DataOffset;
+        }
+        set_registers(address, values, n);
+    }
+
+    inline void MCP2515Base::request_to_send(uint8_t instruction) {
+        // 1000 0nnn: one bit per transmit buffer
+        for (uint8_t txb = 0; txb < 3; ++txb) {
+            if (instruction & (0x01 << txb)) {
+                modify_register(
+                    TXB0CTRL + txb * BufferStride,
+                    RequestInProcess,
+                    RequestInProcess);
+            }
+        }
+    }
+
+    inline void MCP2515Base::execute(CommandList &list) {
+        run_commands(*this, list);
+    }
+
 }
 
 #endif
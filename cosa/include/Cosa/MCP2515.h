@@ -3,18 +3,27 @@
 
 #include <MCP2515Base.h>
 #include <Cosa/OutputPin.hh>
+#include <Cosa/RTT.hh>
 #include <Cosa/SPI.hh>
+#include <Cosa/Types.h>
 #include <stdint.h>
 
 namespace wlp {
     namespace cosa {
 
-        class MCP2515 :
+        // Declared final with inline transfers so that
+        // BasicMCP2515<cosa::MCP2515> calls them directly
+        class MCP2515 final :
             public wlp::MCP2515Base,
             public SPI::Driver {
         public:
             MCP2515(Board::DigitalPin cs = Board::D10);
 
+            // Handler driven by the INT pin. SPI::acquire() masks it while
+            // any driver on the bus holds SPI, so the handler may read the
+            // chip without racing loop().
+            void set_interrupt_handler(Interrupt::Handler *irq);
+
             void reset(void) override;
             uint8_t read_status(void) override;
             uint8_t read_register(uint8_t address) override;
@@ -22,9 +31,162 @@ namespace wlp {
             void set_register(uint8_t address, uint8_t value) override;
             void set_registers(uint8_t address, uint8_t values[], uint8_t n) override;
             void modify_register(uint8_t address, uint8_t mask, uint8_t data) override;
+            void read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void request_to_send(uint8_t instruction) override;
+            void execute(CommandList &list) override;
+            // micros() widened to 64 bits and scaled to ns; read at least
+            // once per 71.6 min wrap of the RTT counter
+            uint64_t receive_time(uint8_t rxBuf) override;
+            uint64_t now(void) override;
+            // The outermost session acquires SPI, which also applies this
+            // driver's clock and mode, and masks the interrupt handler
+            void begin_session(void) override;
+            void end_session(void) override;
+
+        private:
+            uint64_t micros(void);
+
+            uint8_t m_session;
+            WideCounter m_micros;
         };
 
     }
+
+    inline void cosa::MCP2515::set_interrupt_handler(Interrupt::Handler *irq) {
+        m_irq = irq;
+    }
+
+    inline void cosa::MCP2515::begin_session(void) {
+        // Acquire before counting: the handler can only run while the
+        // count is 0, and then it takes and releases the bus on its own
+        if (0 == m_session) {
+            spi.acquire(this);
+        }
+        ++m_session;
+    }
+
+    inline void cosa::MCP2515::end_session(void) {
+        if (0 == --m_session) {
+            spi.release();
+        }
+    }
+
+    inline void cosa::MCP2515::reset(void) {
+        begin_session();
+        spi.begin();
+        spi.transfer(Instruction::Reset);
+        spi.end();
+        end_session();
+    }
+
+    inline uint8_t cosa::MCP2515::read_status(void) {
+        uint8_t tx[2] = {Instruction::ReadStatus, Instruction::Fetch};
+        uint8_t rx[2] = {0, 0};
+        begin_session();
+        spi.begin();
+        spi.transfer(rx, tx, 2);
+        spi.end();
+        end_session();
+        return rx[1];
+    }
+
+    inline uint8_t cosa::MCP2515::read_register(uint8_t address) {
+        uint8_t tx[3] = {Instruction::Read, address, Instruction::Fetch};
+        uint8_t rx[3] = {0, 0, 0};
+        begin_session();
+        spi.begin();
+        spi.transfer(rx, tx, 3);
+        spi.end();
+        end_session();
+        return rx[2];
+    }
+
+    inline void cosa::MCP2515::read_registers(uint8_t address, uint8_t values[], uint8_t n) {
+        uint8_t tx[2] = {Instruction::Read, address};
+        begin_session();
+        spi.begin();
+        spi.transfer(tx, 2);
+        spi.read(values, n);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::set_register(uint8_t address, uint8_t value) {
+        uint8_t tx[3] = {Instruction::Write, address, value};
+        begin_session();
+        spi.begin();
+        spi.transfer(tx, 3);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::set_registers(uint8_t address, uint8_t values[], uint8_t n) {
+        uint8_t tx[2] = {Instruction::Write, address};
+        begin_session();
+        spi.begin();
+        spi.transfer(tx, 2);
+        spi.transfer(values, n);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::modify_register(uint8_t address, uint8_t mask, uint8_t data) {
+        uint8_t tx[4] = {Instruction::Modify, address, mask, data};
+        begin_session();
+        spi.begin();
+        spi.transfer(tx, 4);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+        begin_session();
+        spi.begin();
+        spi.transfer(instruction);
+        spi.read(values, n);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+        begin_session();
+        spi.begin();
+        spi.transfer(instruction);
+        spi.write(values, n);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::request_to_send(uint8_t instruction) {
+        begin_session();
+        spi.begin();
+        spi.transfer(instruction);
+        spi.end();
+        end_session();
+    }
+
+    inline void cosa::MCP2515::execute(CommandList &list) {
+        run_commands(*this, list);
+    }
+
+    inline uint64_t cosa::MCP2515::receive_time(uint8_t) {
+        return micros() * 1000ull;
+    }
+
+    inline uint64_t cosa::MCP2515::now(void) {
+        return micros() * 1000ull;
+    }
+
+    inline uint64_t cosa::MCP2515::micros(void) {
+        // The receiver's handler reads the clock as well
+        uint64_t us;
+        synchronized {
+            us = m_micros.extend(RTT::micros());
+        }
+        return us;
+    }
+
 }
 
 #endif
@@ -0,0 +1,150 @@
+#ifndef __COSA_MCP2515_RECEIVER_H__
+#define __COSA_MCP2515_RECEIVER_H__
+
+#include <Cosa/MCP2515.h>
+#include <Cosa/ExternalInterrupt.hh>
+#include <Cosa/Types.h>
+#include <MCP2515.h>
+
+namespace wlp {
+    namespace cosa {
+
+        /**
+         * Drains RXB0/RXB1 from the INT pin's external interrupt into a
+         * static ring of N frames, N a power of two up to 128. loop()
+         * takes frames with read_frame() without touching SPI, so slow
+         * work there no longer loses frames to a full chip.
+         *
+         * The ISR reads every pending frame even when the ring is full,
+         * counting the ones it drops, so INT always goes high again and
+         * the next falling edge is seen.
+         * It also runs service_errors() and service_transmit(), so the
+         * state and transmit callbacks are called from the ISR, and
+         * repeats until no enabled flag is left: an event that arrives
+         * while another flag holds INT low makes no edge of its own.
+         */
+        template<uint8_t N>
+        class Receiver : public ExternalInterrupt {
+        public:
+            Receiver(
+                Board::ExternalInterruptPin pin,
+                MCP2515 *base, BasicMCP2515<MCP2515> *bus);
+
+            // Call after bus->begin()
+            void begin(void);
+            void end(void);
+
+            // MessageState::MessageFetched or MessageState::NoMessage
+            uint8_t read_frame(CanFrame *frame);
+            uint8_t available(void) const;
+            // frames dropped because the ring was full
+            uint16_t dropped(void) const;
+            // frames lost on the chip because RXB0/RXB1 were both full
+            uint16_t overruns(void) const;
+
+            void on_interrupt(uint16_t arg = 0) override;
+
+        private:
+            static_assert(N > 0 && N <= 128 && 0 == (N & (N - 1)),
+                          "ring size must be a power of two up to 128");
+
+            MCP2515 *m_base;
+            BasicMCP2515<MCP2515> *m_bus;
+            CanFrame m_frames[N];
+            // single bytes, so loads and stores are atomic on AVR
+            volatile uint8_t m_head;
+            volatile uint8_t m_tail;
+            volatile uint16_t m_dropped;
+            volatile uint16_t m_overruns;
+        };
+
+    }
+
+    template<uint8_t N>
+    cosa::Receiver<N>::Receiver(
+            Board::ExternalInterruptPin pin,
+            MCP2515 *base, BasicMCP2515<MCP2515> *bus) :
+        ExternalInterrupt(pin, ExternalInterrupt::ON_FALLING_MODE),
+        m_base(base),
+        m_bus(bus),
+        m_head(0),
+        m_tail(0),
+        m_dropped(0),
+        m_overruns(0) {}
+
+    template<uint8_t N>
+    void cosa::Receiver<N>::begin(void) {
+        m_base->set_interrupt_handler(this);
+        enable();
+        // Frames that arrived before the edge detector was armed; an edge
+        // during the drain stays latched and finds nothing to do
+        synchronized {
+            on_interrupt();
+        }
+    }
+
+    template<uint8_t N>
+    void cosa::Receiver<N>::end(void) {
+        disable();
+        m_base->set_interrupt_handler(nullptr);
+    }
+
+    template<uint8_t N>
+    uint8_t cosa::Receiver<N>::read_frame(CanFrame *frame) {
+        uint8_t tail = m_tail;
+        if (tail == m_head) {
+            return MessageState::NoMessage;
+        }
+        *frame = m_frames[tail & (N - 1)];
+        m_tail = tail + 1;
+        return MessageState::MessageFetched;
+    }
+
+    template<uint8_t N>
+    uint8_t cosa::Receiver<N>::available(void) const {
+        return m_head - m_tail;
+    }
+
+    template<uint8_t N>
+    uint16_t cosa::Receiver<N>::dropped(void) const {
+        uint16_t dropped;
+        synchronized {
+            dropped = m_dropped;
+        }
+        return dropped;
+    }
+
+    template<uint8_t N>
+    uint16_t cosa::Receiver<N>::overruns(void) const {
+        uint16_t overruns;
+        synchronized {
+            overruns = m_overruns;
+        }
+        return overruns;
+    }
+
+    template<uint8_t N>
+    void cosa::Receiver<N>::on_interrupt(uint16_t) {
+        CanFrame batch[2];
+        uint8_t head = m_head;
+        uint8_t n;
+        do {
+            while (0 != (n = m_bus->read_frames(batch, 2))) {
+                for (uint8_t i = 0; i < n; ++i) {
+                    if ((uint8_t) (head - m_tail) >= N) {
+                        ++m_dropped;
+                        continue;
+                    }
+                    m_frames[head & (N - 1)] = batch[i];
+                    m_head = ++head;
+                }
+            }
+            m_overruns += m_bus->clear_overflow();
+            m_bus->service_errors();
+            m_bus->service_transmit();
+        } while (0 != m_bus->pending_interrupts());
+    }
+
+}
+
+#endif
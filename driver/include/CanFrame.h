@@ -0,0 +1,35 @@
+#ifndef __CAN_FRAME_H__
+#define __CAN_FRAME_H__
+
+#include <stdint.h>
+
+namespace wlp {
+
+    namespace FrameFlag {
+        enum {
+            Extended = 0x01,
+            RemoteRequest = 0x02,
+        };
+    }
+
+    struct CanFrame {
+        uint32_t id;
+        uint8_t flags;
+        uint8_t dlc;
+        uint8_t data[8];
+    };
+
+    // Receive metadata, kept apart from CanFrame so transmit storage
+    // does not pay for it
+    struct FrameInfo {
+        // ns on the backend's monotonic clock, taken at the INT edge
+        // when the backend captures it, otherwise when the frame was seen
+        uint64_t timestamp;
+        // Counts every frame read from the controller, including frames
+        // the software filter drops
+        uint32_t sequence;
+    };
+
+}
+
+#endif
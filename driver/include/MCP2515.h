@@ -3,45 +3,273 @@
 
 #include <MCP2515Base.h>
 #include <MCP2515Const.h>
+#include <CanFrame.h>
+#include <MCP2515Timing.h>
+#include <MCP2515Stats.h>
+#include <SoftwareFilter.h>
 
 namespace wlp {
 
-    class MCP2515 {
+    // Called from service_transmit() once a queued frame has left its
+    // transmit buffer, with Result::OK, Result::SendAborted or
+    // Result::Expired.
+    typedef void (*TransmitCallback)(void *context, uint16_t tag, uint8_t result);
+
+    struct SendOptions {
+        // SendFlag bits
+        uint8_t flags;
+        // MCP2515Base::now() time in ns after which the frame is aborted
+        // and reported as Result::Expired, 0 for none
+        uint64_t deadline;
+    };
+
+    struct TransmitEntry {
+        CanFrame frame;
+        uint16_t tag;
+        // TransmitPriority class
+        uint8_t priority;
+        uint8_t flags;
+        uint64_t deadline;
+    };
+
+    struct BusErrors {
+        // BusState
+        uint8_t state;
+        uint8_t tec;
+        uint8_t rec;
+        // EFLG as last read, overflow bits included
+        uint8_t eflg;
+        // frames lost because RXB0/RXB1 were both full
+        uint32_t rxOverflows;
+        uint32_t busOffs;
+        uint32_t restarts;
+    };
+
+    // Called from service_errors() whenever the BusState changes
+    typedef void (*BusStateCallback)(void *context, uint8_t state, const BusErrors *errors);
+
+    struct RecoveryPolicy {
+        // Recovery mode
+        uint8_t mode;
+        // ns in bus-off before a restart. A bus-off within maxDelay of
+        // the previous restart doubles it, up to maxDelay.
+        uint64_t delay;
+        uint64_t maxDelay;
+        // Restarts in such a series before leaving it to the chip, 0 for
+        // no limit
+        uint8_t maxAttempts;
+    };
+
+    struct AcceptanceFilter {
+        uint32_t id;
+        // FrameFlag::Extended matches 29-bit identifiers
+        uint8_t flags;
+    };
+
+    // Complete acceptance setup for configure_acceptance(). RXM0 with
+    // RXF0-1 guard RXB0, RXM1 with RXF2-5 guard RXB1. rxControl holds the
+    // RXControlMask bits for RXB0CTRL and RXB1CTRL: AcceptAny turns the
+    // filters off, AcceptOnlyStandardID/AcceptOnlyExtendedID restrict the
+    // frame type and AcceptBUKT lets RXB0 roll over into RXB1.
+    struct AcceptanceConfig {
+        AcceptanceFilter masks[2];
+        AcceptanceFilter filters[6];
+        uint8_t rxControl[2];
+    };
+
+    /**
+     * Front-end driver. Base is the backend type every register access
+     * goes through: BasicMCP2515<MCP2515Base> (the MCP2515 typedef) works
+     * with any backend through virtual calls, naming a concrete backend
+     * instead, e.g. BasicMCP2515<cosa::MCP2515>, lets the compiler call
+     * and inline its methods directly.
+     */
+    template<typename Base>
+    class BasicMCP2515 {
     public:
-        explicit MCP2515(MCP2515Base *base);
+        explicit BasicMCP2515(Base *base);
 
         uint8_t begin(uint8_t canSpeed, uint8_t clockSpeed);
+        // Start with timing from solve_bit_timing() or bit_timing<>()
+        uint8_t begin(const BitTiming &timing);
         uint8_t set_filter(uint8_t num, uint32_t data);
         uint8_t set_mask(uint8_t num, uint32_t data);
+        // Apply every mask, filter and receive mode in a single config
+        // mode session, then return to the mode the controller was in
+        uint8_t configure_acceptance(const AcceptanceConfig *config);
+        // Legacy forms of send_frame() and read_frame(): the id picks the
+        // frame format (above 0xFFFF is extended), only the payload is
+        // returned and get_id() reports the id of the frame read last
         uint8_t send_buffer(uint32_t id, uint8_t len, uint8_t *buf);
+        // Blocking send. Waits for a free buffer and for the frame to
+        // leave, up to the deadline or else Limit::SendTimeout for each;
+        // on backends without a clock, Limit::AwaitBufferTimeout polls and
+        // the deadline is ignored. A frame still pending at its deadline
+        // is aborted.
+        uint8_t send_frame(const CanFrame *frame, const SendOptions *options = nullptr);
         uint8_t read_buffer(uint8_t len, uint8_t *buf);
+        uint8_t read_frame(CanFrame *frame, FrameInfo *info = nullptr);
+        // Drain up to max frames from RXB0 and RXB1 with a single status
+        // read, oldest first. Returns the number of frames fetched; info,
+        // when given, receives a timestamp and sequence number per frame.
+        uint8_t read_frames(CanFrame frames[], uint8_t max, FrameInfo info[] = nullptr);
+        // Frames not admitted by the filter are dropped before they reach
+        // read_buffer(), read_frame() or read_frames(); nullptr detaches it
+        void set_software_filter(SoftwareFilter *filter);
+
+        // Interrupt-driven transmission. Frames are queued in caller-owned
+        // storage and moved into TXB0-TXB2 as buffers free up; call
+        // service_transmit() whenever the INT pin fires.
+        //
+        // Higher TransmitPriority classes leave the queue first; within a
+        // class frames keep their queue order. Urgent frames are loaded
+        // with TXP 3, the other classes share TXP 0-2: each frame gets
+        // the highest TXP and buffer that still sends it after the frames
+        // in flight of its class or above, so a drained buffer can be
+        // refilled at once. An Urgent frame that finds every buffer busy
+        // aborts the lowest class frame in flight, which goes back to the
+        // front of its class.
+        //
+        // Deadlines are checked by service_transmit(), so call it
+        // periodically as well when they are used. CANCTRL.OSM applies to
+        // all buffers at once: a OneShot frame waits until no regular
+        // frame is in flight and the other way around.
+        void set_transmit_queue(
+                TransmitEntry entries[], uint8_t capacity,
+                TransmitCallback callback, void *context);
+        uint8_t try_send(
+                const CanFrame *frame, uint16_t tag,
+                uint8_t priority = TransmitPriority::Low,
+                const SendOptions *options = nullptr);
+        uint8_t queue_send(
+                const CanFrame *frame, uint16_t tag,
+                uint8_t priority = TransmitPriority::Low,
+                const SendOptions *options = nullptr);
+        uint8_t service_transmit();
+        uint8_t pending_transmit();
+
+        // Register shadow. The driver keeps a write-through copy of the
+        // configuration it owns and skips writes and reads it can answer
+        // itself. resync() reloads the copy from the chip and verify()
+        // reports Result::Failed if the chip no longer matches it.
+        uint8_t set_mode(uint8_t mode);
+        void resync();
+        uint8_t verify();
+
+        uint8_t clear_overflow();
         uint8_t get_error();
+
+        // Error tracking. Enables the ERRIF interrupt; service_errors()
+        // then follows EFLG, TEC and REC each time INT fires, clears
+        // RX0OVR/RX1OVR and applies the recovery policy (nullptr for
+        // Recovery::Automatic). While a restart is pending, call it
+        // periodically as well. Returns the BusState.
+        void set_error_handler(
+                BusStateCallback callback, void *context,
+                const RecoveryPolicy *policy = nullptr);
+        uint8_t service_errors();
+        const BusErrors &bus_errors() const;
+        // Reset the chip and restore the configuration and mode it had.
+        // Frames in the transmit buffers are queued again.
+        uint8_t restart();
+
+        // Counters kept with MCP2515_STATS, all zero without it. The copy
+        // is not synchronized with a thread using the driver, so fields
+        // may be a few events apart.
+        void stats(DriverStats *snapshot) const;
+        void clear_stats();
         uint8_t get_message_status();
+        // CANINTF bits that are enabled and still set; INT is released
+        // once this is 0
+        uint8_t pending_interrupts();
+        // CANINTF as read, enabled or not
+        uint8_t interrupt_flags();
         uint32_t get_id();
 
     private:
-        MCP2515Base *m_base;
+        Base *m_base;
 
+        // for get_id(), from the last read_buffer()
         uint32_t m_id;
 
-        uint8_t m_extFlag;
-        uint8_t m_remoteRequestFlag;
-        uint8_t m_filterFlag;
+        TransmitEntry *m_txQueue;
+        uint8_t m_txCapacity;
+        uint8_t m_txHead;
+        uint8_t m_txCount;
+        TransmitCallback m_txCallback;
+        void *m_txContext;
+        uint8_t m_txOwned;
+        uint8_t m_txPreempted;
+        uint8_t m_txExpired;
+        TransmitEntry m_txEntries[Limit::TXBuffers];
+        // TXP each owned buffer was loaded with
+        uint8_t m_txLevels[Limit::TXBuffers];
 
-        uint8_t m_dataLength;
-        uint8_t m_messageData[Limit::MessageBufferLength];
+        bool m_rx1First;
+        SoftwareFilter *m_softwareFilter;
+        uint32_t m_rxSequence;
 
-        void write_CAN_msg(uint8_t bufferSidhAddr);
-        void read_CAN_msg(uint8_t bufferSidhAddr);
-        void start_transmit(uint8_t mcpAddr);
-        uint8_t get_next_free_buf(uint8_t *txBuf);
+        enum {
+            ControlReset = 0x87,
+            ShadowLength = 37,
+        };
 
-        void set_msg(uint32_t id, uint8_t len, uint8_t *data);
-        void clear_msg();
-        uint8_t read_msg();
-        uint8_t send_msg();
+        bool m_synced;
+        uint8_t m_control;
+        uint8_t m_cnf[3];
+        uint8_t m_interruptEnable;
+        uint8_t m_filters[24];
+        uint8_t m_masks[8];
+        uint8_t m_txRequested;
+
+        bool m_errorsEnabled;
+        BusStateCallback m_errorCallback;
+        void *m_errorContext;
+        RecoveryPolicy m_recovery;
+        BusErrors m_errors;
+        bool m_restartPending;
+        uint8_t m_restartAttempts;
+        uint64_t m_restartAt;
+        uint64_t m_lastRestart;
+        uint64_t m_backoff;
+
+#if MCP2515_STATS
+        DriverStats m_stats;
+        uint64_t m_txStart[Limit::TXBuffers];
+
+        void count_sent(uint8_t txBuf);
+#endif
+
+        uint8_t get_next_free_buf(uint8_t *txBuf);
+        bool gave_up(uint64_t deadline, uint64_t start, uint16_t polls);
+        bool select_one_shot(CommandList &list, uint8_t flags, uint8_t busy);
+        uint8_t expire_queued(uint64_t now);
+        void set_bus_state(uint8_t state, uint64_t now);
+        void requeue_in_flight();
+        uint8_t write_config_id(uint8_t address, uint8_t shadow[], uint32_t id);
+        uint8_t fetch_frames(CanFrame frames[], uint8_t max, FrameInfo info[]);
+        uint8_t current_mode();
+        uint8_t close_config_session(CommandList &list, uint8_t mode);
+        void read_config(uint8_t regs[]);
+        uint8_t load_queued(uint8_t status);
+        uint8_t tx_place(uint8_t txBuf) const;
+        uint8_t free_buffer(uint8_t priority, uint8_t busy, uint8_t *level);
+        uint8_t preempt(CommandList &list, uint8_t priority, uint8_t busy);
+        void insert_queued(const TransmitEntry &entry, bool ahead);
+        void load_frame(
+                CommandList &list, uint8_t raw[], uint8_t txBuf,
+                const CanFrame *frame, uint8_t priority);
     };
 
+    typedef BasicMCP2515<MCP2515Base> MCP2515;
+
+}
+
+#include <MCP2515Impl.h>
+
+namespace wlp {
+    // Compiled once in MCP2515.cpp
+    extern template class BasicMCP2515<MCP2515Base>;
 }
 
 #endif
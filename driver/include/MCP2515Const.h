@@ -8,13 +8,16 @@ namespace wlp {
             SIDH = 0,  // Standard ID high
             SIDL = 1,  // Standard ID low
             EIDH = 2,  // Extended ID high
-            EIDL = 3  // Extended ID low
+            EIDL = 3,  // Extended ID low
+            DLC = 4,  // Data length code
+            D0 = 5  // First data byte
         };
     }
 
     namespace Mask {
         enum {
             ExtendedID = 0x08,
+            StandardRemoteRequest = 0x10,
             DLC = 0x0F,
             RemoteRequest = 0x40,
         };
@@ -32,8 +35,29 @@ namespace wlp {
 
     namespace TXControlMask {
         enum {
+            Priority = 0x03,
             RequestInProcess = 0x08,
-            Error = 0x10
+            Error = 0x10,
+            LostArbitration = 0x20,
+            Aborted = 0x40,
+        };
+    }
+
+    // Transmit priority classes, written to TXBnCTRL.TXP. Urgent frames
+    // may abort a lower class frame to get a transmit buffer.
+    namespace TransmitPriority {
+        enum {
+            Low = 0x00,
+            Normal = 0x01,
+            High = 0x02,
+            Urgent = 0x03,
+        };
+    }
+
+    namespace SendFlag {
+        enum {
+            // Single attempt, CANCTRL.OSM is set while the frame is loaded
+            OneShot = 0x01,
         };
     }
 
@@ -65,9 +89,44 @@ namespace wlp {
         };
     }
 
+    namespace ErrorFlag {
+        enum {
+            Warning = 0x01,
+            RXWarning = 0x02,
+            TXWarning = 0x04,
+            RXPassive = 0x08,
+            TXPassive = 0x10,
+            BusOff = 0x20,
+            RX0Overflow = 0x40,
+            RX1Overflow = 0x80,
+        };
+    }
+
+    // Fault confinement state derived from EFLG
+    namespace BusState {
+        enum {
+            ErrorActive = 0x00,
+            // TEC or REC at 96 or more, still error-active
+            ErrorWarning = 0x01,
+            ErrorPassive = 0x02,
+            BusOff = 0x03,
+        };
+    }
+
+    namespace Recovery {
+        enum {
+            // Leave bus-off to the chip, after 128 x 11 recessive bits
+            Automatic = 0x00,
+            // Reset the chip and restore its configuration after a delay
+            Restart = 0x01,
+        };
+    }
+
     namespace ErrorMask {
         enum {
-            Any = 0b11111000
+            Any = 0b11111000,
+            Passive = 0b00011000,
+            RXOverflow = 0b11000000,
         };
     }
 
@@ -102,6 +161,8 @@ namespace wlp {
             RXF5EIDL = 0x1B,
             Status = 0x0E,
             Control = 0x0F,
+            TXErrorCount = 0x1C,
+            RXErrorCount = 0x1D,
             // RXM#@@@@ are mask registers, 0 through 5
             // SID: standard identifier bits (16)
             // EID: extended identifier bits (16)
@@ -161,6 +222,9 @@ namespace wlp {
             LoadTX2 = 0x44,
             ReadRX0 = 0x90,
             ReadRX1 = 0x94,
+            RequestToSend0 = 0x81,
+            RequestToSend1 = 0x82,
+            RequestToSend2 = 0x84,
         };
     }
 
@@ -198,7 +262,8 @@ namespace wlp {
     /* Clock Speeds */
     enum {
         MCP_16MHz = 1,
-        MCP_8MHz  = 2
+        MCP_8MHz  = 2,
+        MCP_20MHz = 3
     };
 
     enum {
@@ -238,6 +303,9 @@ namespace wlp {
             AwaitBufferTimedOut = 0x02,
             SendTimedOut = 0x03,
             AllBuffersBusy = 0x04,
+            QueueFull = 0x05,
+            SendAborted = 0x06,
+            Expired = 0x07,
         };
     }
 
@@ -247,6 +315,10 @@ namespace wlp {
             MessageBufferLength = 0x08,
             TXBufferLength = 0x10,
             TXBuffers = 0x03,
+            FrameLength = 0x0D,
+            MaxPriority = 0x03,
+            // us a blocking send waits when the backend has a clock
+            SendTimeout = 10000,
         };
     }
 
@@ -0,0 +1,1220 @@
+#ifndef __MCP2515_IMPL_H__
+#define __MCP2515_IMPL_H__
+
+// Member definitions of BasicMCP2515, included by MCP2515.h
+
+namespace wlp {
+
+    namespace detail {
+
+        uint32_t oscillator_hz(uint8_t clockSpeed);
+        uint32_t bitrate_hz(uint8_t canSpeed);
+        void encode_id(uint8_t buf[], uint32_t id, bool extended);
+        void init_buffers(CommandList &list);
+        uint32_t decode_id(const uint8_t buf[]);
+        void encode_frame(uint8_t raw[], const CanFrame *frame);
+        void decode_frame(const uint8_t raw[], CanFrame *frame);
+        void open_config_session(CommandList &list, uint8_t *control);
+        void encode_config_id(uint8_t buf[], uint32_t id, bool extended, bool mask);
+
+        // RTS carries one bit per buffer to send: 0x81, 0x82, 0x84
+        inline uint8_t request_to_send(uint8_t buffers) {
+            return Instruction::RequestToSend | buffers;
+        }
+
+        inline uint8_t tx_status_pending(uint8_t txBuf) {
+            return Status::TX0Pending << (2 * txBuf);
+        }
+
+        inline uint8_t tx_status_fired(uint8_t txBuf) {
+            return Status::TX0InterruptFired << (2 * txBuf);
+        }
+
+        // One bit per transmit buffer with TXREQ set
+        inline uint8_t tx_pending(uint8_t status) {
+            uint8_t pending = 0;
+            for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+                if (status & tx_status_pending(i)) {
+                    pending |= 1 << i;
+                }
+            }
+            return pending;
+        }
+
+        inline uint8_t bus_state(uint8_t eflg) {
+            if (eflg & ErrorFlag::BusOff) {
+                return BusState::BusOff;
+            }
+            if (eflg & ErrorMask::Passive) {
+                return BusState::ErrorPassive;
+            }
+            if (eflg & ErrorFlag::Warning) {
+                return BusState::ErrorWarning;
+            }
+            return BusState::ErrorActive;
+        }
+
+        // Deadlines never pass on a backend without a clock
+        inline bool expired(uint64_t deadline, uint64_t now) {
+            return 0 != deadline && 0 != now && now >= deadline;
+        }
+
+        inline bool same_bytes(const uint8_t a[], const uint8_t b[], uint8_t n) {
+            for (uint8_t i = 0; i < n; ++i) {
+                if (a[i] != b[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline void copy_bytes(uint8_t dst[], const uint8_t src[], uint8_t n) {
+            for (uint8_t i = 0; i < n; ++i) {
+                dst[i] = src[i];
+            }
+        }
+
+    }
+
+    template<typename Base>
+    BasicMCP2515<Base>::BasicMCP2515(Base *base) :
+        m_base(base),
+        m_id(0),
+        m_txQueue(nullptr),
+        m_txCapacity(0),
+        m_txHead(0),
+        m_txCount(0),
+        m_txCallback(nullptr),
+        m_txContext(nullptr),
+        m_txOwned(0),
+        m_txPreempted(0),
+        m_txExpired(0),
+        m_rx1First(false),
+        m_softwareFilter(nullptr),
+        m_rxSequence(0),
+        m_synced(false),
+        m_control(0),
+        m_interruptEnable(0),
+        m_txRequested(0),
+        m_errorsEnabled(false),
+        m_errorCallback(nullptr),
+        m_errorContext(nullptr),
+        m_recovery(),
+        m_errors(),
+        m_restartPending(false),
+        m_restartAttempts(0),
+        m_restartAt(0),
+        m_lastRestart(0),
+        m_backoff(0) {
+        clear_stats();
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::begin(uint8_t canSpeed, uint8_t clockSpeed) {
+        return begin(solve_bit_timing(
+                detail::oscillator_hz(clockSpeed),
+                detail::bitrate_hz(canSpeed)));
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::begin(const BitTiming &timing) {
+        if (!timing.valid()) {
+            return Result::Failed;
+        }
+        BusSession<Base> session(m_base);
+        m_base->reset();
+        m_synced = false;
+        m_control = ControlReset;
+        uint8_t res = set_mode(Mode::Config);
+        if (Result::OK != res) {
+            return Result::Failed;
+        }
+        uint8_t cnf[3];
+        detail::copy_bytes(cnf, timing.cnf, 3);
+        uint8_t interrupts = InterruptFlag::RX0 | InterruptFlag::RX1;
+        if (nullptr != m_txQueue) {
+            interrupts |= InterruptMask::TXAll;
+        }
+        if (m_errorsEnabled) {
+            interrupts |= InterruptFlag::Error;
+        }
+        CommandBuffer<12> list;
+        list.write(Register::RateConfig3, cnf, 3);
+        detail::init_buffers(list);
+        list.modify(
+                Register::RXB0CTRL,
+                RXControlMask::AcceptAny | RXControlMask::AcceptAnyID,
+                RXControlMask::AcceptAny | RXControlMask::AcceptBUKT);
+        list.modify(
+                Register::RXB1CTRL,
+                RXControlMask::AcceptAny,
+                RXControlMask::AcceptAnyID);
+        list.modify(Register::InterruptEnable, interrupts, interrupts);
+        m_base->execute(list);
+
+        // Everything begin() writes is now known without reading it back
+        detail::copy_bytes(m_cnf, cnf, 3);
+        for (uint8_t i = 0; i < sizeof(m_filters); ++i) {
+            m_filters[i] = 0;
+        }
+        for (uint8_t i = 0; i < sizeof(m_masks); ++i) {
+            m_masks[i] = 0;
+        }
+        m_interruptEnable = interrupts;
+        m_txOwned = 0;
+        m_txRequested = 0;
+        m_errors.state = BusState::ErrorActive;
+        m_errors.tec = 0;
+        m_errors.rec = 0;
+        m_errors.eflg = 0;
+        m_restartPending = false;
+        m_synced = true;
+
+        res = set_mode(Mode::Normal);
+        if (Result::OK != res) {
+            return Result::Failed;
+        }
+        return Result::OK;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::set_filter(uint8_t filterNumber, uint32_t filter) {
+        if (filterNumber > 5) {
+            return Result::Failed;
+        } else if (filterNumber < 3) {
+            return write_config_id(
+                    Register::RXF0SIDH + 0x04 * filterNumber,
+                    &m_filters[4 * filterNumber], filter);
+        } else {
+            return write_config_id(
+                    Register::RXF3SIDH + 0x04 * (filterNumber - 3),
+                    &m_filters[4 * filterNumber], filter);
+        }
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::set_mask(uint8_t maskNumber, uint32_t mask) {
+        if (maskNumber > 1) {
+            return Result::Failed;
+        }
+        return write_config_id(
+                Register::RXM0SIDH + 0x04 * maskNumber,
+                &m_masks[4 * maskNumber], mask);
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::set_mode(uint8_t newMode) {
+        if (m_synced && (m_control & ControlMask::Mode) == newMode) {
+            return Result::OK;
+        }
+        uint8_t control = 0;
+        CommandBuffer<2> list;
+        list.modify(Register::Control, ControlMask::Mode, newMode);
+        list.read(Register::Control, &control, 1);
+        m_base->execute(list);
+        m_control = control;
+        return ((control & ControlMask::Mode) == newMode) ? Result::OK : Result::Failed;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::current_mode() {
+        if (!m_synced) {
+            m_control = m_base->read_register(Register::Control);
+        }
+        return m_control & ControlMask::Mode;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::close_config_session(CommandList &list, uint8_t mode) {
+        uint8_t control = 0;
+        list.modify(Register::Control, ControlMask::Mode, mode);
+        list.read(Register::Control, &control, 1);
+        m_base->execute(list);
+        m_control = control;
+        return ((control & ControlMask::Mode) == mode) ? Result::OK : Result::Failed;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::write_config_id(uint8_t address, uint8_t shadow[], uint32_t id) {
+        uint8_t buf[4];
+        detail::encode_config_id(buf, id, 0 != (id >> 16), address >= Register::RXM0SIDH);
+        if (m_synced && detail::same_bytes(buf, shadow, 4)) {
+            return Result::OK;
+        }
+        BusSession<Base> session(m_base);
+        uint8_t mode = current_mode();
+        uint8_t config = 0;
+        CommandBuffer<5> list;
+        detail::open_config_session(list, &config);
+        list.write(address, buf, 4);
+        uint8_t res = close_config_session(list, mode);
+        if ((config & ControlMask::Mode) != Mode::Config) {
+            return Result::Failed;
+        }
+        detail::copy_bytes(shadow, buf, 4);
+        return res;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::configure_acceptance(const AcceptanceConfig *config) {
+        uint8_t filters[24];
+        uint8_t masks[8];
+        for (uint8_t i = 0; i < 6; ++i) {
+            const AcceptanceFilter &filter = config->filters[i];
+            detail::encode_config_id(
+                    &filters[4 * i], filter.id,
+                    filter.flags & FrameFlag::Extended, false);
+        }
+        for (uint8_t i = 0; i < 2; ++i) {
+            const AcceptanceFilter &mask = config->masks[i];
+            detail::encode_config_id(
+                    &masks[4 * i], mask.id,
+                    mask.flags & FrameFlag::Extended, true);
+        }
+        BusSession<Base> session(m_base);
+        uint8_t mode = current_mode();
+        uint8_t control = 0;
+        CommandBuffer<9> list;
+        detail::open_config_session(list, &control);
+        // Only the blocks that differ from the shadow are written
+        if (!m_synced || !detail::same_bytes(filters, m_filters, 12)) {
+            list.write(Register::RXF0SIDH, filters, 12);
+        }
+        if (!m_synced || !detail::same_bytes(&filters[12], &m_filters[12], 12)) {
+            list.write(Register::RXF3SIDH, &filters[12], 12);
+        }
+        if (!m_synced || !detail::same_bytes(masks, m_masks, 8)) {
+            list.write(Register::RXM0SIDH, masks, 8);
+        }
+        list.modify(
+                Register::RXB0CTRL,
+                RXControlMask::AcceptAny | RXControlMask::AcceptBUKT,
+                config->rxControl[0]);
+        list.modify(
+                Register::RXB1CTRL,
+                RXControlMask::AcceptAny,
+                config->rxControl[1]);
+        uint8_t res = close_config_session(list, mode);
+        if ((control & ControlMask::Mode) != Mode::Config) {
+            return Result::Failed;
+        }
+        detail::copy_bytes(m_filters, filters, sizeof(m_filters));
+        detail::copy_bytes(m_masks, masks, sizeof(m_masks));
+        return res;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::read_config(uint8_t regs[]) {
+        // CANCTRL, CNF3..CANINTE, RXF0-2, RXF3-5, RXM0-1
+        CommandBuffer<5> list;
+        list.read(Register::Control, &regs[0], 1);
+        list.read(Register::RateConfig3, &regs[1], 4);
+        list.read(Register::RXF0SIDH, &regs[5], 12);
+        list.read(Register::RXF3SIDH, &regs[17], 12);
+        list.read(Register::RXM0SIDH, &regs[29], 8);
+        m_base->execute(list);
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::resync() {
+        uint8_t regs[ShadowLength];
+        read_config(regs);
+        m_control = regs[0];
+        detail::copy_bytes(m_cnf, &regs[1], 3);
+        m_interruptEnable = regs[4];
+        detail::copy_bytes(m_filters, &regs[5], sizeof(m_filters));
+        detail::copy_bytes(m_masks, &regs[29], sizeof(m_masks));
+        m_txRequested = (1 << Limit::TXBuffers) - 1;
+        m_synced = true;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::verify() {
+        if (!m_synced) {
+            return Result::Failed;
+        }
+        uint8_t regs[ShadowLength];
+        read_config(regs);
+        bool same =
+            (regs[0] & ControlMask::Mode) == (m_control & ControlMask::Mode) &&
+            detail::same_bytes(&regs[1], m_cnf, 3) &&
+            regs[4] == m_interruptEnable &&
+            detail::same_bytes(&regs[5], m_filters, sizeof(m_filters)) &&
+            detail::same_bytes(&regs[29], m_masks, sizeof(m_masks));
+        return same ? Result::OK : Result::Failed;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::send_buffer(uint32_t id, uint8_t len, uint8_t *buf) {
+        CanFrame frame;
+        frame.id = id;
+        frame.flags = 0;
+        if (0 != (id >> 16)) {
+            frame.flags = FrameFlag::Extended;
+        }
+        frame.dlc = len;
+        if (frame.dlc > Limit::MessageBufferLength) {
+            frame.dlc = Limit::MessageBufferLength;
+        }
+        detail::copy_bytes(frame.data, buf, frame.dlc);
+        return send_frame(&frame);
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::read_buffer(uint8_t len, uint8_t *buf) {
+        CanFrame frame;
+        uint8_t state = read_frame(&frame);
+        if (MessageState::MessageFetched == state) {
+            m_id = frame.id;
+            detail::copy_bytes(buf, frame.data, (frame.dlc < len) ? frame.dlc : len);
+        }
+        return state;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::read_frame(CanFrame *frame, FrameInfo *info) {
+        BusSession<Base> session(m_base);
+        // Single-frame form of read_frames, nothing to compact
+        while (0 != fetch_frames(frame, 1, info)) {
+            if (nullptr == m_softwareFilter || m_softwareFilter->admit(frame)) {
+                return MessageState::MessageFetched;
+            }
+        }
+        return MessageState::NoMessage;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::read_frames(CanFrame frames[], uint8_t max, FrameInfo info[]) {
+        BusSession<Base> session(m_base);
+        while (true) {
+            uint8_t n = fetch_frames(frames, max, info);
+            if (0 == n || nullptr == m_softwareFilter) {
+                return n;
+            }
+            uint8_t kept = 0;
+            for (uint8_t i = 0; i < n; ++i) {
+                if (m_softwareFilter->admit(&frames[i])) {
+                    if (kept != i) {
+                        frames[kept] = frames[i];
+                        if (nullptr != info) {
+                            info[kept] = info[i];
+                        }
+                    }
+                    ++kept;
+                }
+            }
+            // Keep draining while everything fetched was rejected, the INT
+            // pin stays low until both buffers are empty
+            if (0 != kept) {
+                return kept;
+            }
+        }
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::set_software_filter(SoftwareFilter *filter) {
+        m_softwareFilter = filter;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::fetch_frames(CanFrame frames[], uint8_t max, FrameInfo info[]) {
+        if (0 == max) {
+            return 0;
+        }
+        uint8_t status = m_base->read_status();
+        uint8_t order[2];
+        uint8_t n = 0;
+        // With rollover RX1 only fills while RX0 is occupied, so RX0 holds the
+        // older frame unless an earlier call left RX1 behind and RX0 has been
+        // refilled since.
+        uint8_t first = m_rx1First ? 1 : 0;
+        for (uint8_t i = 0; i < 2; ++i) {
+            uint8_t rxBuf = first ^ i;
+            if (n < max && (status & (Status::RX0InterruptFired << rxBuf))) {
+                order[n++] = rxBuf;
+            }
+        }
+        if (0 == n) {
+            m_rx1First = false;
+            return 0;
+        }
+        uint64_t timestamps[2] = {0, 0};
+        for (uint8_t i = 0; i < n && nullptr != info; ++i) {
+            timestamps[i] = m_base->receive_time(order[i]);
+        }
+
+        uint8_t raw[2][Limit::FrameLength];
+        CommandBuffer<2> list;
+        for (uint8_t i = 0; i < n; ++i) {
+            list.read_rx_buffer(
+                    order[i] ? Instruction::ReadRX1 : Instruction::ReadRX0,
+                    raw[i], Limit::FrameLength);
+        }
+        m_base->execute(list);
+        for (uint8_t i = 0; i < n; ++i) {
+            detail::decode_frame(raw[i], &frames[i]);
+            if (nullptr != info) {
+                info[i].timestamp = timestamps[i];
+                info[i].sequence = m_rxSequence;
+            }
+            ++m_rxSequence;
+        }
+        MCP2515_STAT(m_stats.framesReceived += n;)
+
+        // A buffer left pending is older than anything that lands in the one
+        // just freed
+        uint8_t pending = status & StatusMask::RXInterruptMask;
+        for (uint8_t i = 0; i < n; ++i) {
+            pending &= ~(Status::RX0InterruptFired << order[i]);
+        }
+        m_rx1First = 0 != (pending & Status::RX1InterruptFired);
+        return n;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::clear_overflow() {
+        BusSession<Base> session(m_base);
+        uint8_t eflg = m_base->read_register(Register::ErrorFlag);
+        uint8_t overflow = eflg & ErrorMask::RXOverflow;
+        if (0 == overflow) {
+            return 0;
+        }
+        m_base->modify_register(Register::ErrorFlag, overflow, 0);
+        if (!m_errorsEnabled) {
+            // The overflow raised ERRIF, which service_errors() would
+            // otherwise clear
+            m_base->modify_register(Register::InterruptFlag, InterruptFlag::Error, 0);
+        }
+        uint8_t lost = (overflow & ErrorFlag::RX0Overflow ? 1 : 0) +
+                       (overflow & ErrorFlag::RX1Overflow ? 1 : 0);
+        m_errors.rxOverflows += lost;
+        MCP2515_STAT(m_stats.rxOverruns += lost;)
+        return lost;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::get_error() {
+        uint8_t eflg = m_base->read_register(Register::ErrorFlag);
+        return (eflg & ErrorMask::Any) ? Error::ControlError : Error::None;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::set_error_handler(
+            BusStateCallback callback, void *context,
+            const RecoveryPolicy *policy) {
+        m_errorCallback = callback;
+        m_errorContext = context;
+        m_recovery = (nullptr != policy) ? *policy : RecoveryPolicy();
+        m_restartPending = false;
+        m_restartAttempts = 0;
+        m_backoff = m_recovery.delay;
+        m_errorsEnabled = true;
+        if (m_synced && (m_interruptEnable & InterruptFlag::Error)) {
+            return;
+        }
+        m_base->modify_register(
+                Register::InterruptEnable, InterruptFlag::Error, InterruptFlag::Error);
+        m_interruptEnable |= InterruptFlag::Error;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::service_errors() {
+        if (!m_errorsEnabled) {
+            return m_errors.state;
+        }
+        BusSession<Base> session(m_base);
+        uint64_t now = m_base->now();
+        if (m_base->read_register(Register::InterruptFlag) & InterruptFlag::Error) {
+            // Clear ERRIF before reading, so a change after the read
+            // raises it again
+            uint8_t counters[2];
+            uint8_t eflg = 0;
+            CommandBuffer<3> list;
+            list.modify(Register::InterruptFlag, InterruptFlag::Error, 0);
+            list.read(Register::TXErrorCount, counters, 2);
+            list.read(Register::ErrorFlag, &eflg, 1);
+            m_base->execute(list);
+            uint8_t overflow = eflg & ErrorMask::RXOverflow;
+            if (0 != overflow) {
+                m_base->modify_register(Register::ErrorFlag, overflow, 0);
+                uint8_t lost = (overflow & ErrorFlag::RX0Overflow ? 1 : 0) +
+                               (overflow & ErrorFlag::RX1Overflow ? 1 : 0);
+                m_errors.rxOverflows += lost;
+                MCP2515_STAT(m_stats.rxOverruns += lost;)
+            }
+            m_errors.tec = counters[0];
+            m_errors.rec = counters[1];
+            m_errors.eflg = eflg;
+            set_bus_state(detail::bus_state(eflg), now);
+        }
+        if (m_restartPending && (0 == now || now >= m_restartAt)) {
+            restart();
+        }
+        return m_errors.state;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::set_bus_state(uint8_t state, uint64_t now) {
+        if (state == m_errors.state) {
+            return;
+        }
+        m_errors.state = state;
+        if (BusState::BusOff == state) {
+            ++m_errors.busOffs;
+            if (Recovery::Restart == m_recovery.mode) {
+                // Back off further while restarts keep ending in bus-off
+                if (0 != m_lastRestart && now - m_lastRestart < m_recovery.maxDelay) {
+                    m_backoff = (m_backoff * 2 < m_recovery.maxDelay)
+                        ? m_backoff * 2 : m_recovery.maxDelay;
+                } else {
+                    m_backoff = m_recovery.delay;
+                    m_restartAttempts = 0;
+                }
+                if (0 == m_recovery.maxAttempts ||
+                    m_restartAttempts < m_recovery.maxAttempts) {
+                    m_restartPending = true;
+                    m_restartAt = now + m_backoff;
+                }
+            }
+        } else {
+            // The chip recovered by itself
+            m_restartPending = false;
+        }
+        if (nullptr != m_errorCallback) {
+            m_errorCallback(m_errorContext, state, &m_errors);
+        }
+    }
+
+    template<typename Base>
+    const BusErrors &BasicMCP2515<Base>::bus_errors() const {
+        return m_errors;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::restart() {
+        BusSession<Base> session(m_base);
+        if (!m_synced) {
+            resync();
+        }
+        uint8_t mode = m_control & ControlMask::Mode;
+        uint8_t rxControl[2];
+        CommandBuffer<2> read;
+        read.read(Register::RXB0CTRL, &rxControl[0], 1);
+        read.read(Register::RXB1CTRL, &rxControl[1], 1);
+        m_base->execute(read);
+
+        m_base->reset();
+        m_control = ControlReset;
+        CommandBuffer<9> list;
+        list.write(Register::RateConfig3, m_cnf, 3);
+        list.write(Register::RXF0SIDH, &m_filters[0], 12);
+        list.write(Register::RXF3SIDH, &m_filters[12], 12);
+        list.write(Register::RXM0SIDH, m_masks, 8);
+        list.set(Register::RXB0CTRL, rxControl[0]);
+        list.set(Register::RXB1CTRL, rxControl[1]);
+        list.set(Register::InterruptEnable, m_interruptEnable);
+        uint8_t res = close_config_session(list, mode);
+
+        ++m_errors.restarts;
+        ++m_restartAttempts;
+        m_lastRestart = m_base->now();
+        m_restartPending = false;
+        m_errors.tec = 0;
+        m_errors.rec = 0;
+        m_errors.eflg = 0;
+        set_bus_state(BusState::ErrorActive, m_lastRestart);
+        requeue_in_flight();
+        return res;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::requeue_in_flight() {
+        // The reset emptied TXB0-TXB2; the highest buffer of a class was
+        // loaded first, so going upwards leaves it in front
+        uint8_t owned = m_txOwned;
+        m_txOwned = 0;
+        m_txRequested = 0;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if (!(owned & (1 << i))) {
+                continue;
+            }
+            uint8_t result = Result::SendAborted;
+            if (m_txExpired & (1 << i)) {
+                result = Result::Expired;
+            } else if (m_txCount < m_txCapacity) {
+                insert_queued(m_txEntries[i], true);
+                continue;
+            }
+            if (nullptr != m_txCallback) {
+                m_txCallback(m_txContext, m_txEntries[i].tag, result);
+            }
+        }
+        m_txPreempted = 0;
+        m_txExpired = 0;
+        if (0 != m_txCount) {
+            load_queued(m_base->read_status());
+        }
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::get_message_status() {
+        uint8_t res = m_base->read_status();
+        return (res & StatusMask::RXInterruptMask)
+            ? MessageState::MessagePending
+            : MessageState::NoMessage;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::pending_interrupts() {
+        return m_base->read_register(Register::InterruptFlag) & m_interruptEnable;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::interrupt_flags() {
+        return m_base->read_register(Register::InterruptFlag);
+    }
+
+    template<typename Base>
+    uint32_t BasicMCP2515<Base>::get_id() {
+        return m_id;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::get_next_free_buf(uint8_t *txBuf) {
+        *txBuf = 0x00;
+        // A buffer whose completion was already observed is known to be idle
+        uint8_t busy = m_txOwned | m_txRequested;
+        for (uint8_t i = 0; i < Limit::TXBuffers; i++) {
+            if (!(busy & (1 << i))) {
+                *txBuf = i;
+                return Result::OK;
+            }
+        }
+        uint8_t status = m_base->read_status();
+        for (uint8_t i = 0; i < Limit::TXBuffers; i++) {
+            if (m_txOwned & (1 << i)) {
+                continue;
+            }
+            if (!(status & detail::tx_status_pending(i))) {
+                m_txRequested &= ~(1 << i);
+                *txBuf = i;
+                return Result::OK;
+            }
+        }
+        return Result::AllBuffersBusy;
+    }
+
+    template<typename Base>
+    bool BasicMCP2515<Base>::gave_up(uint64_t deadline, uint64_t start, uint16_t polls) {
+        uint64_t now = m_base->now();
+        if (0 == now) {
+            return polls >= Limit::AwaitBufferTimeout;
+        }
+        if (0 != deadline) {
+            return now >= deadline;
+        }
+        return now - start >= Limit::SendTimeout * 1000ull;
+    }
+
+    template<typename Base>
+    bool BasicMCP2515<Base>::select_one_shot(CommandList &list, uint8_t flags, uint8_t busy) {
+        uint8_t osm = (flags & SendFlag::OneShot) ? Mode::OneShot : 0;
+        if ((m_control & Mode::OneShot) == osm) {
+            return true;
+        }
+        // CANCTRL.OSM covers every buffer, switch only while none is busy
+        if (0 != busy) {
+            return false;
+        }
+        list.modify(Register::Control, Mode::OneShot, osm);
+        m_control = (m_control & ~Mode::OneShot) | osm;
+        return true;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::send_frame(const CanFrame *frame, const SendOptions *options) {
+        uint8_t flags = (nullptr != options) ? options->flags : 0;
+        uint64_t deadline = (nullptr != options) ? options->deadline : 0;
+        BusSession<Base> session(m_base);
+        uint8_t raw[1 + Limit::FrameLength];
+        CommandBuffer<3> list;
+        uint64_t start = m_base->now();
+        if (0 == start) {
+            // No clock, so no deadline: time out as without one
+            deadline = 0;
+        }
+        uint16_t polls = 0;
+        uint8_t txBuf;
+        while (Result::OK != get_next_free_buf(&txBuf) ||
+               !select_one_shot(list, flags, m_txOwned | m_txRequested)) {
+            MCP2515_STAT(++m_stats.txBusyWaits;)
+            if (gave_up(deadline, start, ++polls)) {
+                MCP2515_STAT(++m_stats.timeouts;)
+                return (0 != deadline) ? Result::Expired : Result::AwaitBufferTimedOut;
+            }
+            // Frames from try_send() may have left meanwhile
+            m_txRequested &= detail::tx_pending(m_base->read_status());
+        }
+        load_frame(list, raw, txBuf, frame, TransmitPriority::Low);
+        list.request_to_send(detail::request_to_send(1 << txBuf));
+        m_base->execute(list);
+        m_txRequested |= 1 << txBuf;
+
+        uint8_t address = Register::TXB0CTRL + txBuf * Limit::TXBufferLength;
+        uint8_t control;
+        bool expired = false;
+        start = m_base->now();
+        MCP2515_STAT(m_txStart[txBuf] = start;)
+        polls = 0;
+        while ((control = m_base->read_register(address)) & TXControlMask::RequestInProcess) {
+            MCP2515_STAT(++m_stats.txBusyWaits;)
+            if (expired || !gave_up(deadline, start, ++polls)) {
+                continue;
+            }
+            if (0 == deadline) {
+                MCP2515_STAT(++m_stats.timeouts;)
+                return Result::SendTimedOut;
+            }
+            // A frame already on the bus still completes
+            m_base->modify_register(address, TXControlMask::RequestInProcess, 0);
+            expired = true;
+        }
+        m_txRequested &= ~(1 << txBuf);
+        if (nullptr != m_txQueue) {
+            // TXnIE is enabled for the queue, don't leave INT asserted
+            m_base->modify_register(Register::InterruptFlag, InterruptFlag::TX0 << txBuf, 0);
+        }
+        if (control & TXControlMask::Aborted) {
+            MCP2515_STAT(m_stats.timeouts += expired ? 1 : 0;)
+            return expired ? Result::Expired : Result::SendAborted;
+        }
+        MCP2515_STAT(count_sent(txBuf);)
+        return Result::OK;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::set_transmit_queue(
+            TransmitEntry entries[], uint8_t capacity,
+            TransmitCallback callback, void *context) {
+        m_txQueue = entries;
+        m_txCapacity = capacity;
+        m_txHead = 0;
+        m_txCount = 0;
+        m_txCallback = callback;
+        m_txContext = context;
+        m_txPreempted = 0;
+        m_txExpired = 0;
+        uint8_t interrupts = (nullptr != entries) ? InterruptMask::TXAll : 0;
+        if (m_synced && (m_interruptEnable & InterruptMask::TXAll) == interrupts) {
+            return;
+        }
+        m_base->modify_register(Register::InterruptEnable, InterruptMask::TXAll, interrupts);
+        m_interruptEnable = (m_interruptEnable & ~InterruptMask::TXAll) | interrupts;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::load_frame(
+            CommandList &list, uint8_t raw[], uint8_t txBuf,
+            const CanFrame *frame, uint8_t priority) {
+        // Write TXBnCTRL together with the frame so TXP is set in the same
+        // transaction; TXREQ stays clear until the RTS instruction.
+        raw[0] = priority & TXControlMask::Priority;
+        detail::encode_frame(raw + 1, frame);
+        uint8_t dlc = raw[1 + Bits::DLC] & Mask::DLC;
+        list.write(
+                Register::TXB0CTRL + txBuf * Limit::TXBufferLength,
+                raw, 1 + Bits::D0 + dlc);
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::tx_place(uint8_t txBuf) const {
+        // The chip sends the highest TXP first and, within one TXP, the
+        // highest buffer number
+        return m_txLevels[txBuf] * Limit::TXBuffers + txBuf;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::free_buffer(uint8_t priority, uint8_t busy, uint8_t *level) {
+        // Urgent frames have TXP 3 to themselves, the other classes share
+        // the places below it
+        uint8_t bottom = 0;
+        uint8_t limit = TransmitPriority::Urgent * Limit::TXBuffers;
+        if (TransmitPriority::Urgent == priority) {
+            bottom = limit;
+            limit += Limit::TXBuffers;
+        }
+        // A frame has to go after every frame in flight of its class or
+        // above, and takes the highest place left below them
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if ((m_txOwned & (1 << i)) && m_txEntries[i].priority >= priority &&
+                tx_place(i) < limit) {
+                limit = tx_place(i);
+            }
+        }
+        while (limit > bottom) {
+            --limit;
+            if (!(busy & (1 << (limit % Limit::TXBuffers)))) {
+                *level = limit / Limit::TXBuffers;
+                return limit % Limit::TXBuffers;
+            }
+        }
+        return Limit::TXBuffers;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::preempt(CommandList &list, uint8_t priority, uint8_t busy) {
+        // One abort at a time, and only if the victim can be queued again
+        if (0 != m_txPreempted || m_txCount >= m_txCapacity) {
+            return Limit::TXBuffers;
+        }
+        // Lowest class, and within it the buffer that would go last
+        uint8_t victim = Limit::TXBuffers;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if (!(m_txOwned & ~m_txExpired & (1 << i)) || m_txEntries[i].priority >= priority) {
+                continue;
+            }
+            if (Limit::TXBuffers == victim ||
+                m_txEntries[i].priority < m_txEntries[victim].priority ||
+                (m_txEntries[i].priority == m_txEntries[victim].priority &&
+                 tx_place(i) < tx_place(victim))) {
+                victim = i;
+            }
+        }
+        // The freed buffer has to be one the frame may take
+        uint8_t level;
+        if (Limit::TXBuffers != victim &&
+            free_buffer(priority, busy & ~(1 << victim), &level) != victim) {
+            victim = Limit::TXBuffers;
+        }
+        if (Limit::TXBuffers != victim) {
+            list.modify(
+                    Register::TXB0CTRL + victim * Limit::TXBufferLength,
+                    TXControlMask::RequestInProcess, 0);
+            m_txPreempted |= 1 << victim;
+        }
+        return victim;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::insert_queued(const TransmitEntry &entry, bool ahead) {
+        // The queue stays sorted by class, first in first out within one
+        uint8_t pos = m_txCount;
+        for (uint8_t k = 0; k < m_txCount; ++k) {
+            uint8_t p = m_txQueue[(m_txHead + k) % m_txCapacity].priority;
+            if (p < entry.priority || (ahead && p == entry.priority)) {
+                pos = k;
+                break;
+            }
+        }
+        for (uint8_t k = m_txCount; k > pos; --k) {
+            m_txQueue[(m_txHead + k) % m_txCapacity] =
+                m_txQueue[(m_txHead + k - 1) % m_txCapacity];
+        }
+        m_txQueue[(m_txHead + pos) % m_txCapacity] = entry;
+        ++m_txCount;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::try_send(
+            const CanFrame *frame, uint16_t tag, uint8_t priority,
+            const SendOptions *options) {
+        if (nullptr != m_txQueue && 0 != m_txCount &&
+            m_txQueue[m_txHead].priority >= priority) {
+            // keep ordering behind frames already queued
+            return Result::AllBuffersBusy;
+        }
+        priority &= TXControlMask::Priority;
+        uint8_t flags = (nullptr != options) ? options->flags : 0;
+        BusSession<Base> session(m_base);
+        uint8_t raw[1 + Limit::FrameLength];
+        CommandBuffer<4> list;
+        uint8_t level;
+        uint8_t txBuf = free_buffer(priority, m_txOwned | m_txRequested, &level);
+        if (Limit::TXBuffers == txBuf ||
+            !select_one_shot(list, flags, m_txOwned | m_txRequested)) {
+            // Buffers loaded by send_buffer() may have gone out meanwhile
+            m_txRequested &= detail::tx_pending(m_base->read_status());
+            txBuf = free_buffer(priority, m_txOwned | m_txRequested, &level);
+            if (Limit::TXBuffers == txBuf ||
+                !select_one_shot(list, flags, m_txOwned | m_txRequested)) {
+                return Result::AllBuffersBusy;
+            }
+        }
+        if (nullptr == m_txQueue) {
+            // Nothing to keep in order without the queue
+            level = priority;
+        }
+        load_frame(list, raw, txBuf, frame, level);
+        if (nullptr != m_txQueue) {
+            // A timed out send_frame() may have left TXnIF set, which
+            // service_transmit() would take for this frame's completion
+            list.modify(Register::InterruptFlag, InterruptFlag::TX0 << txBuf, 0);
+        }
+        list.request_to_send(detail::request_to_send(1 << txBuf));
+        m_base->execute(list);
+        MCP2515_STAT(m_txStart[txBuf] = m_base->now();)
+        if (nullptr == m_txQueue) {
+            m_txRequested |= 1 << txBuf;
+            return Result::OK;
+        }
+        m_txOwned |= 1 << txBuf;
+        m_txLevels[txBuf] = level;
+        m_txEntries[txBuf].frame = *frame;
+        m_txEntries[txBuf].tag = tag;
+        m_txEntries[txBuf].priority = priority;
+        m_txEntries[txBuf].flags = flags;
+        m_txEntries[txBuf].deadline = (nullptr != options) ? options->deadline : 0;
+        return Result::OK;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::queue_send(
+            const CanFrame *frame, uint16_t tag, uint8_t priority,
+            const SendOptions *options) {
+        if (nullptr == m_txQueue) {
+            return Result::Failed;
+        }
+        // service_transmit() may run from an interrupt handler, which the
+        // session keeps out while the queue changes
+        BusSession<Base> session(m_base);
+        if (m_txCount >= m_txCapacity) {
+            return Result::QueueFull;
+        }
+        TransmitEntry entry;
+        entry.frame = *frame;
+        entry.tag = tag;
+        entry.priority = priority & TXControlMask::Priority;
+        entry.flags = (nullptr != options) ? options->flags : 0;
+        entry.deadline = (nullptr != options) ? options->deadline : 0;
+        insert_queued(entry, false);
+        if (m_txOwned != (1 << Limit::TXBuffers) - 1 ||
+            TransmitPriority::Urgent == entry.priority) {
+            load_queued(m_base->read_status());
+        }
+        return Result::OK;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::load_queued(uint8_t status) {
+        // Buffers left to send_frame() or try_send() stay untouched
+        m_txRequested &= detail::tx_pending(status);
+        uint8_t busy = m_txOwned | m_txRequested | detail::tx_pending(status);
+        uint8_t raw[Limit::TXBuffers][1 + Limit::FrameLength];
+        CommandBuffer<Limit::TXBuffers + 3> list;
+        uint8_t rts = 0;
+        uint8_t loaded = 0;
+        uint8_t victim = Limit::TXBuffers;
+        while (0 != m_txCount) {
+            TransmitEntry *entry = &m_txQueue[m_txHead];
+            if (!select_one_shot(list, entry->flags, busy)) {
+                break;
+            }
+            uint8_t level;
+            uint8_t i = free_buffer(entry->priority, busy, &level);
+            if (Limit::TXBuffers == i) {
+                if (TransmitPriority::Urgent == entry->priority) {
+                    victim = preempt(list, entry->priority, busy);
+                }
+                break;
+            }
+            load_frame(list, raw[i], i, &entry->frame, level);
+            m_txOwned |= 1 << i;
+            m_txLevels[i] = level;
+            busy |= 1 << i;
+            m_txEntries[i] = *entry;
+            rts |= 1 << i;
+            if (++m_txHead == m_txCapacity) {
+                m_txHead = 0;
+            }
+            --m_txCount;
+            ++loaded;
+        }
+        // Same for a TXnIF left by a timed out send_frame()
+        uint8_t stale = 0;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if ((rts & (1 << i)) && (status & detail::tx_status_fired(i))) {
+                stale |= InterruptFlag::TX0 << i;
+            }
+        }
+        if (0 != stale) {
+            list.modify(Register::InterruptFlag, stale, 0);
+        }
+        if (0 != rts) {
+            list.request_to_send(detail::request_to_send(rts));
+        }
+        if (0 != list.size()) {
+            m_base->execute(list);
+        }
+#if MCP2515_STATS
+        uint64_t now = (0 != rts) ? m_base->now() : 0;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if (rts & (1 << i)) {
+                m_txStart[i] = now;
+            }
+        }
+#endif
+        if (Limit::TXBuffers != victim) {
+            // Clearing TXREQ raises no interrupt, so take the buffer back
+            // here unless the frame had already made it onto the bus
+            uint8_t control = m_base->read_register(
+                    Register::TXB0CTRL + victim * Limit::TXBufferLength);
+            if (!(control & TXControlMask::RequestInProcess) &&
+                (control & TXControlMask::Aborted)) {
+                m_txOwned &= ~(1 << victim);
+                m_txPreempted &= ~(1 << victim);
+                insert_queued(m_txEntries[victim], true);
+                loaded += load_queued(status & ~detail::tx_status_pending(victim));
+            }
+        }
+        return loaded;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::service_transmit() {
+        if (nullptr == m_txQueue) {
+            return 0;
+        }
+        BusSession<Base> session(m_base);
+        uint64_t now = m_base->now();
+        uint8_t done = expire_queued(now);
+        // Abort frames in flight past their deadline, the outcome shows in
+        // the status below unless the frame was already on the bus
+        CommandBuffer<Limit::TXBuffers> aborts;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if ((m_txOwned & ~m_txExpired & (1 << i)) &&
+                detail::expired(m_txEntries[i].deadline, now)) {
+                aborts.modify(
+                        Register::TXB0CTRL + i * Limit::TXBufferLength,
+                        TXControlMask::RequestInProcess, 0);
+                m_txExpired |= 1 << i;
+            }
+        }
+        if (0 != aborts.size()) {
+            m_base->execute(aborts);
+        }
+        uint8_t status = m_base->read_status();
+        uint8_t clear = 0;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if (!(m_txOwned & (1 << i))) {
+                // A frame from send_frame() that timed out completes
+                // without a callback, but its TXnIF still holds INT
+                if (status & detail::tx_status_fired(i)) {
+                    clear |= InterruptFlag::TX0 << i;
+                }
+                continue;
+            }
+            uint8_t result;
+            if (status & detail::tx_status_fired(i)) {
+                clear |= InterruptFlag::TX0 << i;
+                result = Result::OK;
+            } else if (!(status & detail::tx_status_pending(i))) {
+                // TXREQ cleared without TXnIF: the transmission was aborted
+                result = Result::SendAborted;
+            } else {
+                continue;
+            }
+            m_txOwned &= ~(1 << i);
+            if (m_txExpired & (1 << i)) {
+                m_txExpired &= ~(1 << i);
+                m_txPreempted &= ~(1 << i);
+                if (Result::SendAborted == result) {
+                    result = Result::Expired;
+                    MCP2515_STAT(++m_stats.timeouts;)
+                }
+            } else if (m_txPreempted & (1 << i)) {
+                m_txPreempted &= ~(1 << i);
+                // Made room for an urgent frame, send it again later
+                if (Result::SendAborted == result && m_txCount < m_txCapacity) {
+                    insert_queued(m_txEntries[i], true);
+                    continue;
+                }
+            }
+            ++done;
+#if MCP2515_STATS
+            if (Result::OK == result) {
+                count_sent(i);
+            }
+#endif
+            if (nullptr != m_txCallback) {
+                m_txCallback(m_txContext, m_txEntries[i].tag, result);
+            }
+        }
+        if (0 != clear) {
+            m_base->modify_register(Register::InterruptFlag, clear, 0);
+        }
+        if (0 != m_txCount) {
+            // every TXnIF seen in the status is cleared above
+            load_queued(status & ~StatusMask::TXInterruptMask);
+        }
+        return done;
+    }
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::expire_queued(uint64_t now) {
+        uint8_t expired = 0;
+        uint8_t k = 0;
+        while (k < m_txCount) {
+            TransmitEntry entry = m_txQueue[(m_txHead + k) % m_txCapacity];
+            if (!detail::expired(entry.deadline, now)) {
+                ++k;
+                continue;
+            }
+            // Close the gap before the callback, which may queue again
+            for (uint8_t j = k + 1; j < m_txCount; ++j) {
+                m_txQueue[(m_txHead + j - 1) % m_txCapacity] =
+                    m_txQueue[(m_txHead + j) % m_txCapacity];
+            }
+            --m_txCount;
+            ++expired;
+            MCP2515_STAT(++m_stats.timeouts;)
+            if (nullptr != m_txCallback) {
+                m_txCallback(m_txContext, entry.tag, Result::Expired);
+            }
+        }
+        return expired;
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::stats(DriverStats *snapshot) const {
+#if MCP2515_STATS
+        *snapshot = m_stats;
+#else
+        *snapshot = DriverStats();
+#endif
+    }
+
+    template<typename Base>
+    void BasicMCP2515<Base>::clear_stats() {
+#if MCP2515_STATS
+        m_stats = DriverStats();
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            m_txStart[i] = 0;
+        }
+#endif
+    }
+
+#if MCP2515_STATS
+    template<typename Base>
+    void BasicMCP2515<Base>::count_sent(uint8_t txBuf) {
+        ++m_stats.framesSent;
+        uint64_t now = m_base->now();
+        if (0 != now && 0 != m_txStart[txBuf]) {
+            m_stats.sendToComplete.record(now - m_txStart[txBuf]);
+        }
+    }
+#endif
+
+    template<typename Base>
+    uint8_t BasicMCP2515<Base>::pending_transmit() {
+        uint8_t inFlight = 0;
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if (m_txOwned & (1 << i)) {
+                ++inFlight;
+            }
+        }
+        return m_txCount + inFlight;
+    }
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __MCP2515_STATS_H__
+#define __MCP2515_STATS_H__
+
+#include <stdint.h>
+
+// Define MCP2515_STATS=1 for the whole build to keep counters in the
+// driver and the Linux backend. It changes their layout, so every
+// translation unit has to agree on it. With 0 the counting code is not
+// compiled and snapshots read as all zero.
+#ifndef MCP2515_STATS
+#define MCP2515_STATS 0
+#endif
+
+#if MCP2515_STATS
+#define MCP2515_STAT(...) __VA_ARGS__
+#else
+#define MCP2515_STAT(...)
+#endif
+
+namespace wlp {
+
+    // Power of two buckets over microseconds: bucket 0 counts samples
+    // under 1 us, bucket i those under 2^i us, the last one the rest
+    struct LatencyHistogram {
+        enum { Buckets = 16 };
+
+        uint32_t buckets[Buckets];
+        uint32_t samples;
+        // ns
+        uint64_t max;
+
+        void record(uint64_t ns) {
+            uint32_t us = (uint32_t) (ns / 1000 < 0xFFFFFFFF ? ns / 1000 : 0xFFFFFFFF);
+            uint8_t bucket = 0;
+            while (0 != us && bucket < Buckets - 1) {
+                us >>= 1;
+                ++bucket;
+            }
+            ++buckets[bucket];
+            ++samples;
+            if (ns > max) {
+                max = ns;
+            }
+        }
+    };
+
+    struct DriverStats {
+        // frames seen to complete, from send_frame() or service_transmit()
+        uint32_t framesSent;
+        // frames read out of RXB0/RXB1, software filter rejects included
+        uint32_t framesReceived;
+        // polls in send_frame() that found no buffer or the frame pending
+        uint32_t txBusyWaits;
+        // blocking sends that timed out and frames that expired
+        uint32_t timeouts;
+        // frames lost with RXB0 and RXB1 both full
+        uint32_t rxOverruns;
+        // RTS to the completion being seen, needs a backend clock
+        LatencyHistogram sendToComplete;
+    };
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef __MCP2515_TIMING_H__
+#define __MCP2515_TIMING_H__
+
+#include <stdint.h>
+
+namespace wlp {
+
+    // CNF3, CNF2, CNF1 in register order. A solution always sets BTLMODE
+    // in CNF2, so an all-zero value marks an unreachable bitrate.
+    struct BitTiming {
+        uint8_t cnf[3];
+
+        constexpr bool valid() const {
+            return 0 != (cnf[1] & 0x80);
+        }
+    };
+
+    namespace timing {
+
+        enum {
+            // SYNC + PropSeg(1-8) + PS1(1-8) + PS2(2-8)
+            MinQuanta = 5,
+            MaxQuanta = 25,
+            MaxPrescaler = 64,
+            // Accepted bitrate deviation, 1/Tolerance = 0.5%
+            Tolerance = 200,
+        };
+
+        constexpr uint32_t clamp(uint32_t v, uint32_t lo, uint32_t hi) {
+            return v < lo ? lo : (v > hi ? hi : v);
+        }
+
+        constexpr uint32_t diff(uint32_t a, uint32_t b) {
+            return a > b ? a - b : b - a;
+        }
+
+        // BRP + 1 for n time quanta per bit, TQ = 2 * (BRP + 1) / Fosc
+        constexpr uint32_t prescaler(uint32_t osc, uint32_t rate, uint32_t n) {
+            return clamp((osc + rate * n) / (2 * rate * n), 1, MaxPrescaler);
+        }
+
+        constexpr uint32_t rate_error(uint32_t osc, uint32_t rate, uint32_t n) {
+            return diff(osc / (2 * prescaler(osc, rate, n) * n), rate);
+        }
+
+        // PS2 closest to the sample point (in 1/1000 of a bit) that keeps
+        // PropSeg + PS1 within 16 quanta and no shorter than PS2
+        constexpr uint32_t phase2(uint32_t n, uint32_t sp) {
+            return clamp(
+                n - (sp * n + 500) / 1000,
+                n > 19 ? n - 17 : 2,
+                (n - 1) / 2 < 8 ? (n - 1) / 2 : 8);
+        }
+
+        constexpr uint32_t sample_error(uint32_t n, uint32_t sp) {
+            return diff((n - phase2(n, sp)) * 1000 / n, sp);
+        }
+
+        constexpr bool better(uint32_t osc, uint32_t rate, uint32_t sp, uint32_t n, uint32_t best) {
+            return rate_error(osc, rate, n) < rate_error(osc, rate, best) ||
+                   (rate_error(osc, rate, n) == rate_error(osc, rate, best) &&
+                    sample_error(n, sp) < sample_error(best, sp));
+        }
+
+        // Walks n downwards so that ties keep the finer quantum
+        constexpr uint32_t search(uint32_t osc, uint32_t rate, uint32_t sp, uint32_t n, uint32_t best) {
+            return n < MinQuanta
+                ? best
+                : search(osc, rate, sp, n - 1, better(osc, rate, sp, n, best) ? n : best);
+        }
+
+        constexpr BitTiming encode(uint32_t brp, uint32_t prop, uint32_t ps1, uint32_t ps2) {
+            return BitTiming{{
+                static_cast<uint8_t>(ps2 - 1),
+                static_cast<uint8_t>(0x80 | ((ps1 - 1) << 3) | (prop - 1)),
+                static_cast<uint8_t>(((ps2 > 4 ? 4 : ps2 - 1) - 1) << 6 | (brp - 1)),
+            }};
+        }
+
+        constexpr BitTiming split(uint32_t brp, uint32_t tseg1, uint32_t ps2) {
+            return encode(brp, tseg1 - tseg1 / 2, tseg1 / 2, ps2);
+        }
+
+        constexpr BitTiming make(uint32_t osc, uint32_t rate, uint32_t sp, uint32_t n) {
+            return rate_error(osc, rate, n) * Tolerance > rate
+                ? BitTiming{{0, 0, 0}}
+                : split(prescaler(osc, rate, n), n - 1 - phase2(n, sp), phase2(n, sp));
+        }
+
+    }
+
+    /**
+     * CNF1-CNF3 for an oscillator frequency and bitrate in Hz, with the
+     * sample point in 1/1000 of a bit (875 = 87.5%). Picks the quantum
+     * count with the smallest bitrate error, then the closest sample
+     * point; SJW is the largest value up to 4 that stays below PS2.
+     * Usable at runtime; see bit_timing<>() for checked constants.
+     */
+    constexpr BitTiming solve_bit_timing(
+            uint32_t oscillator, uint32_t bitrate, uint16_t samplePoint = 875) {
+        return (0 == oscillator || 0 == bitrate || samplePoint > 1000)
+            ? BitTiming{{0, 0, 0}}
+            : timing::make(
+                oscillator, bitrate, samplePoint,
+                timing::search(
+                    oscillator, bitrate, samplePoint,
+                    timing::MaxQuanta - 1, timing::MaxQuanta));
+    }
+
+    // Compile-time checked timing, e.g. bit_timing<20000000, 500000>()
+    template<uint32_t Oscillator, uint32_t Bitrate, uint16_t SamplePoint = 875>
+    constexpr BitTiming bit_timing() {
+        static_assert(
+            solve_bit_timing(Oscillator, Bitrate, SamplePoint).valid(),
+            "bitrate not reachable within 0.5% from this oscillator");
+        return solve_bit_timing(Oscillator, Bitrate, SamplePoint);
+    }
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __SOFTWARE_FILTER_H__
+#define __SOFTWARE_FILTER_H__
+
+#include <CanFrame.h>
+
+namespace wlp {
+
+    /**
+     * Acceptance stage for ID sets that do not fit the six hardware
+     * filters. Standard IDs live in a 2048-bit bitmap, extended IDs in an
+     * open-addressed hash table over caller-provided slots. Open the
+     * hardware masks wide enough and attach the filter to the driver with
+     * MCP2515::set_software_filter().
+     */
+    class SoftwareFilter {
+    public:
+        // capacity must be a power of two; one slot always stays free, so
+        // the table holds up to capacity - 1 extended IDs
+        SoftwareFilter(uint32_t slots[], uint16_t capacity);
+
+        void clear(void);
+        // Returns false when the extended table is full
+        bool add(uint32_t id, uint8_t flags);
+        void remove(uint32_t id, uint8_t flags);
+        bool contains(uint32_t id, uint8_t flags) const;
+
+        // contains() that also updates the counters
+        bool admit(const CanFrame *frame);
+        // Frames the hardware let through that were accepted or dropped
+        uint32_t accepted(void) const;
+        uint32_t rejected(void) const;
+        void reset_counters(void);
+
+    private:
+        enum {
+            StandardIDs = 2048,
+            Empty = 0xFFFFFFFF,
+        };
+
+        uint16_t slot(uint32_t id) const;
+
+        uint8_t m_standard[StandardIDs / 8];
+        uint32_t *m_slots;
+        uint16_t m_capacity;
+        uint16_t m_count;
+        uint32_t m_accepted;
+        uint32_t m_rejected;
+    };
+
+}
+
+#endif
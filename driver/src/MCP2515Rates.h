@@ -1,46 +0,0 @@
-#ifndef __MCP2515_RATES_H__
-#define __MCP2515_RATES_H__
-
-#include <stdint.h>
-
-#define NUM_RATES(arr) (sizeof(arr) / sizeof(arr[0]) / 3)
-
-static uint8_t rates16[] = {
-    0x00, 0xD0, 0x82,
-    0x00, 0xF0, 0x86,
-    0x41, 0xF1, 0x85,
-    0x01, 0xFA, 0x87,
-    0x03, 0xF0, 0x86,
-    0x03, 0xFA, 0x87,
-    0x03, 0xFF, 0x87,
-    0x07, 0xFA, 0x87,
-    0x07, 0xFF, 0x87,
-    0x0F, 0xF1, 0x85,
-    0x0F, 0xFF, 0x87,
-    0x1F, 0xFF, 0x87,
-    0x3F, 0xFF, 0x87,
-
-    0x00, 0xA0, 0x04,
-    0x03, 0xAD, 0x07,
-    0x03, 0xBE, 0x07,
-    0x09, 0xBE, 0x07,
-    0X0F, 0XBA, 0X07,
-};
-
-static uint8_t rates8[] = {
-    0x00, 0x80, 0x00,
-    0x00, 0x90, 0x02,
-    0x00, 0xb1, 0x05,
-    0x00, 0xb4, 0x06,
-    0x01, 0xb1, 0x05,
-    0x01, 0xb4, 0x06,
-    0x01, 0xbf, 0x07,
-    0x03, 0xb4, 0x06,
-    0x03, 0xbf, 0x07,
-    0x07, 0xa4, 0x04,
-    0x07, 0xbf, 0x07,
-    0x0f, 0xbf, 0x07,
-    0x1f, 0xbf, 0x07,
-};
-
-#endif
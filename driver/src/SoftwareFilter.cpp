@@ -0,0 +1,120 @@
+#include <SoftwareFilter.h>
+
+using namespace wlp;
+
+SoftwareFilter::SoftwareFilter(uint32_t slots[], uint16_t capacity) :
+    m_slots(slots),
+    m_capacity(capacity) {
+    clear();
+    reset_counters();
+}
+
+void SoftwareFilter::clear(void) {
+    for (uint16_t i = 0; i < sizeof(m_standard); ++i) {
+        m_standard[i] = 0;
+    }
+    for (uint16_t i = 0; i < m_capacity; ++i) {
+        m_slots[i] = Empty;
+    }
+    m_count = 0;
+}
+
+bool SoftwareFilter::add(uint32_t id, uint8_t flags) {
+    if (!(flags & FrameFlag::Extended)) {
+        id &= StandardIDs - 1;
+        m_standard[id >> 3] |= 1 << (id & 0x07);
+        return true;
+    }
+    if (0 == m_capacity) {
+        return false;
+    }
+    id &= 0x1FFFFFFF;
+    uint16_t i = slot(id);
+    while (Empty != m_slots[i]) {
+        if (id == m_slots[i]) {
+            return true;
+        }
+        i = (i + 1) & (m_capacity - 1);
+    }
+    if (m_count + 1 >= m_capacity) {
+        return false;
+    }
+    m_slots[i] = id;
+    ++m_count;
+    return true;
+}
+
+void SoftwareFilter::remove(uint32_t id, uint8_t flags) {
+    if (!(flags & FrameFlag::Extended)) {
+        id &= StandardIDs - 1;
+        m_standard[id >> 3] &= ~(1 << (id & 0x07));
+        return;
+    }
+    if (0 == m_capacity) {
+        return;
+    }
+    id &= 0x1FFFFFFF;
+    uint16_t mask = m_capacity - 1;
+    uint16_t i = slot(id);
+    while (id != m_slots[i]) {
+        if (Empty == m_slots[i]) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    // Backward-shift deletion keeps every probe chain unbroken
+    uint16_t hole = i;
+    for (uint16_t j = (i + 1) & mask; Empty != m_slots[j]; j = (j + 1) & mask) {
+        uint16_t home = slot(m_slots[j]);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            m_slots[hole] = m_slots[j];
+            hole = j;
+        }
+    }
+    m_slots[hole] = Empty;
+    --m_count;
+}
+
+bool SoftwareFilter::contains(uint32_t id, uint8_t flags) const {
+    if (!(flags & FrameFlag::Extended)) {
+        id &= StandardIDs - 1;
+        return 0 != (m_standard[id >> 3] & (1 << (id & 0x07)));
+    }
+    if (0 == m_capacity) {
+        return false;
+    }
+    id &= 0x1FFFFFFF;
+    for (uint16_t i = slot(id); Empty != m_slots[i]; i = (i + 1) & (m_capacity - 1)) {
+        if (id == m_slots[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SoftwareFilter::admit(const CanFrame *frame) {
+    if (contains(frame->id, frame->flags)) {
+        ++m_accepted;
+        return true;
+    }
+    ++m_rejected;
+    return false;
+}
+
+uint32_t SoftwareFilter::accepted(void) const {
+    return m_accepted;
+}
+
+uint32_t SoftwareFilter::rejected(void) const {
+    return m_rejected;
+}
+
+void SoftwareFilter::reset_counters(void) {
+    m_accepted = 0;
+    m_rejected = 0;
+}
+
+uint16_t SoftwareFilter::slot(uint32_t id) const {
+    // Fibonacci hashing, the upper half of the product is well mixed
+    return (uint16_t) ((id * 2654435769u) >> 16) & (m_capacity - 1);
+}
@@ -12,9 +12,9 @@ public:
     void set_register(uint8_t address, uint8_t value) override;
     void modify_register(uint8_t address, uint8_t mask, uint8_t data) override;
     void set_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+    void read_registers(uint8_t address, uint8_t values[], uint8_t n) override;
 
     uint8_t read_status(void) override { assert(false); }
-    void read_registers(uint8_t address, uint8_t values[], uint8_t n) override { assert(false); }
 
 private:
     uint8_t m_regs[256];
@@ -29,6 +29,13 @@ uint8_t MCP2515Test::read_register(uint8_t address) {
     return m_regs[address];
 }
 
+void MCP2515Test::read_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    printf("[INFO] Read many %02x + %d\n", address, n);
+    for (uint8_t i = 0; i < n; ++i) {
+        values[i] = m_regs[address + i];
+    }
+}
+
 void MCP2515Test::set_register(uint8_t address, uint8_t value) {
     printf("[INFO] Set %02x -> %02x\n", address, value);
     m_regs[address] = value;
@@ -46,6 +53,13 @@ void MCP2515Test::set_registers(uint8_t address, uint8_t values[], uint8_t n) {
     }
 }
 
+// 16 MHz, 500 kbps: BRP 1, 16 TQ, PropSeg 7, PS1 6, PS2 2, 87.5%
+static_assert(bit_timing<16000000, 500000>().cnf[0] == 0x01, "CNF3");
+static_assert(bit_timing<16000000, 500000>().cnf[1] == 0xAE, "CNF2");
+static_assert(bit_timing<16000000, 500000>().cnf[2] == 0x00, "CNF1");
+static_assert(bit_timing<20000000, 250000, 800>().valid(), "20 MHz");
+static_assert(!solve_bit_timing(8000000, 1000000).valid(), "below 5 TQ");
+
 int main(void) {
     MCP2515Test base;
     MCP2515 bus(&base);
@@ -54,4 +68,29 @@ int main(void) {
         sleep(1);
     }
     printf("Can Inited\n");
+    assert(bus.set_filter(0, 0) == Result::OK);
+    assert(bus.set_mask(1, 0x7ff) == Result::OK);
+    assert(bus.verify() == Result::OK);
+    printf("Shadow verified\n");
+
+    uint32_t slots[16];
+    SoftwareFilter filter(slots, 16);
+    for (uint32_t id = 0; id < 15; ++id) {
+        assert(filter.add(0x18FF0000 + id * 0x100, FrameFlag::Extended));
+    }
+    assert(!filter.add(0x100, FrameFlag::Extended));
+    assert(filter.add(0x7FF, 0));
+    filter.remove(0x18FF0300, FrameFlag::Extended);
+    for (uint32_t id = 0; id < 15; ++id) {
+        assert(filter.contains(0x18FF0000 + id * 0x100, FrameFlag::Extended) == (3 != id));
+    }
+    assert(filter.contains(0x7FF, 0) && !filter.contains(0x7FF, FrameFlag::Extended));
+    printf("Software filter ok\n");
+
+    for (uint8_t speed = CAN_1000KBPS; speed <= CAN_25KBPS; ++speed) {
+        assert(bus.begin(speed, MCP_16MHz) == Result::OK);
+        assert(bus.begin(speed, MCP_20MHz) == Result::OK || CAN_5KBPS == speed);
+    }
+    assert(bus.begin(bit_timing<20000000, 500000>()) == Result::OK);
+    printf("Bit timing ok\n");
 }
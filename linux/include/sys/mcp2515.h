@@ -2,17 +2,42 @@
 #define __LINUX_MCP2515_H__
 
 #include <MCP2515Base.h>
+#include <MCP2515Stats.h>
+#include <sys/mcp2515_interrupt.h>
 #include <linux/spi/spidev.h>
 #include <poll.h>
 
 namespace wlp {
     namespace linux {
-        class MCP2515 : public wlp::MCP2515Base {
+
+        struct BackendStats {
+            // chip-select cycles and bytes clocked, instructions included
+            uint32_t transactions;
+            uint32_t bytes;
+            // SPI_IOC_MESSAGE calls that failed or came up short
+            uint32_t transferErrors;
+            // INT edges collected by wait_interrupt()
+            uint32_t interrupts;
+            // INT edge to the end of the first receive buffer read after it
+            LatencyHistogram interruptToRead;
+        };
+
+        class MCP2515 final : public wlp::MCP2515Base {
         public:
             MCP2515(const char *dev, int busSpeed);
 
             int setup_interrupt(int gpio);
+            // Take INT edges from source instead of the sysfs pin set up
+            // by setup_interrupt(), nullptr goes back to sysfs
+            void set_interrupt_source(InterruptSource *source);
             int wait_interrupt(int timeout);
+            // CLOCK_MONOTONIC ns of the earliest edge collected by the last
+            // wait_interrupt(); with sysfs, the time poll() returned
+            uint64_t interrupt_time(void) const;
+            // Descriptor that signals an edge, for multiplexing several
+            // controllers: readable for a source, POLLPRI for sysfs.
+            // wait_interrupt(0) consumes the edge.
+            int interrupt_fd(void) const;
 
             int begin(void);
 
@@ -23,19 +48,54 @@ namespace wlp {
             void set_register(uint8_t address, uint8_t value) override;
             void set_registers(uint8_t address, uint8_t values[], uint8_t n) override;
             void modify_register(uint8_t address, uint8_t mask, uint8_t data) override;
+            void read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void request_to_send(uint8_t instruction) override;
+            void execute(CommandList &list) override;
+            // The edge from the last wait_interrupt() for the buffers of
+            // the first read after it, monotonic_ns() for any read after that
+            uint64_t receive_time(uint8_t rxBuf) override;
+            // monotonic_ns()
+            uint64_t now(void) override;
+
+            // Counters kept with MCP2515_STATS, see DriverStats
+            void stats(BackendStats *snapshot) const;
+            void clear_stats(void);
 
         private:
             const char *m_dev;
-            uint8_t m_speed;
+            uint32_t m_speed;
             uint8_t m_bitsPerWord;
             uint8_t m_mode;
             uint8_t m_lsbFirst;
             int m_fd;
             int m_intfd;
             struct pollfd m_pfd;
+            InterruptSource *m_source;
+            uint64_t m_interruptTime;
+            bool m_edgePending;
+            // Buffers of the current read still owed the edge time
+            uint8_t m_edgeBuffers;
             uint8_t m_garbage[8];
 
+            enum { MaxTransfers = 32, MaxEvents = 8 };
+
+            void transfer(spi_ioc_transfer *buf, uint8_t n, uint8_t transactions);
+            void transfer1(uint8_t tx[], uint8_t rx[], uint32_t n);
+            void transfer2(
+                uint8_t tx1[], uint8_t rx1[], uint32_t n1,
+                uint8_t tx2[], uint8_t rx2[], uint32_t n2);
+
+#if MCP2515_STATS
+            BackendStats m_stats;
+            uint64_t m_unreadEdge;
+
+            void count_interrupt(void);
+            void record_read(void);
+#endif
+
             spi_ioc_transfer m_spiBuffer[2];
+            spi_ioc_transfer m_batch[MaxTransfers];
         };
     }
 }
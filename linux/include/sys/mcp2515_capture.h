@@ -0,0 +1,135 @@
+#ifndef __LINUX_MCP2515_CAPTURE_H__
+#define __LINUX_MCP2515_CAPTURE_H__
+
+#include <CanFrame.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace wlp {
+    namespace linux {
+
+        /*
+         * Capture file layout, host byte order: a 32-byte CaptureHeader
+         * followed by 32-byte CaptureRecords, appended in receive order.
+         * A record cut short by a crash is ignored by the reader.
+         */
+        enum {
+            CaptureVersion = 1,
+        };
+
+        struct CaptureHeader {
+            char magic[8];
+            uint16_t version;
+            uint16_t recordSize;
+            uint32_t reserved;
+            // CLOCK_MONOTONIC and CLOCK_REALTIME ns when the capture was
+            // opened, to place record timestamps on the wall clock
+            uint64_t startTime;
+            uint64_t wallTime;
+        };
+
+        struct CaptureRecord {
+            uint64_t timestamp;
+            uint32_t sequence;
+            uint32_t id;
+            uint8_t flags;
+            uint8_t dlc;
+            uint8_t data[8];
+            uint8_t reserved[6];
+        };
+
+        static_assert(sizeof(CaptureHeader) == 32, "capture header layout");
+        static_assert(sizeof(CaptureRecord) == 32, "capture record layout");
+
+        inline void capture_frame(const CaptureRecord *record, CanFrame *frame) {
+            frame->id = record->id;
+            frame->flags = record->flags;
+            frame->dlc = record->dlc;
+            for (uint8_t i = 0; i < 8; ++i) {
+                frame->data[i] = record->data[i];
+            }
+        }
+
+        /**
+         * Appends frames to a capture file from its own thread. push()
+         * only copies the frame into a single-producer/single-consumer
+         * ring, so it is safe to call from the receive thread; the writer
+         * thread hands whole runs of the ring to write(), 64 KiB at a time
+         * under load and at least every flush interval otherwise.
+         *
+         * Size the ring for the longest storage stall to ride out: at
+         * 1 Mbps a bus carries about 8000 frames per second.
+         */
+        class CaptureWriter {
+        public:
+            // capacity must be a power of two
+            CaptureWriter(CaptureRecord ring[], uint32_t capacity);
+            ~CaptureWriter();
+
+            // Truncates path, writes the header and starts the writer
+            int open(const char *path, int flushInterval = 100);
+            // Writes out what is left in the ring and syncs the file
+            int close(void);
+
+            bool push(const CanFrame *frame, const FrameInfo *info);
+
+            // records handed to the file
+            uint64_t written(void) const;
+            // records lost because the ring was full or a write failed
+            uint32_t dropped(void) const;
+
+        private:
+            enum {
+                BatchRecords = 2048,
+            };
+
+            static void *run(void *arg);
+            void flush(uint32_t head);
+
+            CaptureRecord *m_ring;
+            uint32_t m_capacity;
+            int m_fd;
+            int m_flushInterval;
+            pthread_t m_thread;
+            bool m_started;
+
+            std::atomic<bool> m_running;
+            std::atomic<uint32_t> m_head;
+            std::atomic<uint32_t> m_tail;
+            std::atomic<uint64_t> m_written;
+            std::atomic<uint32_t> m_dropped;
+        };
+
+        /**
+         * Maps a capture read-only. Records are accessed in place:
+         *
+         *   for (const CaptureRecord &r : reader) { ... }
+         */
+        class CaptureReader {
+        public:
+            CaptureReader();
+            ~CaptureReader();
+
+            int open(const char *path);
+            void close(void);
+
+            const CaptureHeader *header(void) const;
+            const CaptureRecord *begin(void) const;
+            const CaptureRecord *end(void) const;
+            uint64_t size(void) const;
+
+        private:
+            CaptureReader(const CaptureReader &) = delete;
+            CaptureReader &operator=(const CaptureReader &) = delete;
+
+            int m_fd;
+            void *m_map;
+            size_t m_length;
+            uint64_t m_count;
+        };
+
+    }
+}
+
+#endif
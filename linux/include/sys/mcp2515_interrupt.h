@@ -0,0 +1,84 @@
+#ifndef __LINUX_MCP2515_INTERRUPT_H__
+#define __LINUX_MCP2515_INTERRUPT_H__
+
+#include <stdint.h>
+#include <atomic>
+
+namespace wlp {
+    namespace linux {
+
+        struct InterruptEvent {
+            // CLOCK_MONOTONIC time of the falling edge in ns
+            uint64_t timestamp;
+            // Running count of edges seen on the line, gaps mean the
+            // kernel event queue overflowed
+            uint32_t sequence;
+        };
+
+        /**
+         * Source of MCP2515 INT falling edges for linux::MCP2515.
+         */
+        class InterruptSource {
+        public:
+            virtual ~InterruptSource() {}
+
+            // Wait up to timeout ms (-1 blocks) and fill up to max queued
+            // events. Returns the number of events, 0 on timeout or ERROR.
+            virtual int wait(InterruptEvent events[], int max, int timeout) = 0;
+            // Descriptor that becomes readable on an edge, for callers that
+            // multiplex several sources
+            virtual int fd(void) const = 0;
+        };
+
+        /**
+         * Falling-edge events from the GPIO character device. The kernel
+         * timestamps each edge when it happens and queues them, and
+         * wait() collects every queued edge with a single read().
+         */
+        class GpioInterrupt : public InterruptSource {
+        public:
+            GpioInterrupt();
+            ~GpioInterrupt();
+
+            // chip is e.g. "/dev/gpiochip0", line the offset on that chip
+            int open(const char *chip, uint32_t line);
+            void close(void);
+
+            int wait(InterruptEvent events[], int max, int timeout) override;
+            int fd(void) const override;
+
+        private:
+            enum { MaxEvents = 16 };
+
+            int m_fd;
+        };
+
+        /**
+         * eventfd-backed stand-in for tests and simulations: trigger()
+         * plays the part of the INT pin. Triggers that arrive before the
+         * next wait() are merged and share the timestamp of the last one.
+         */
+        class EventInterrupt : public InterruptSource {
+        public:
+            EventInterrupt();
+            ~EventInterrupt();
+
+            int open(void);
+            void close(void);
+            int trigger(void);
+
+            int wait(InterruptEvent events[], int max, int timeout) override;
+            int fd(void) const override;
+
+        private:
+            int m_fd;
+            uint32_t m_sequence;
+            std::atomic<uint64_t> m_last;
+        };
+
+        uint64_t monotonic_ns(void);
+
+    }
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __LINUX_MCP2515_REACTOR_H__
+#define __LINUX_MCP2515_REACTOR_H__
+
+#include <sys/mcp2515.h>
+#include <MCP2515.h>
+#include <atomic>
+
+namespace wlp {
+    namespace linux {
+
+        // Called with each batch of frames read from a controller; info
+        // holds the matching timestamps and sequence numbers
+        typedef void (*FrameHandler)(
+            void *context, uint8_t controller,
+            const CanFrame frames[], const FrameInfo info[], uint8_t n);
+
+        struct ReactorStats {
+            // frames handed to the handler
+            uint32_t received;
+            // frames lost on the chip because RXB0/RXB1 were both full
+            uint32_t overruns;
+            // turns that ended on the budget with frames still pending
+            uint32_t deferred;
+        };
+
+        /**
+         * Services several controllers from one thread. The INT
+         * descriptors of all registered controllers are waited on with a
+         * single epoll; each controller that fired gets a turn of at most
+         * `budget` frames, and one that still has frames left is carried
+         * over to the next round behind the others, so a saturated bus
+         * cannot starve a quiet one.
+         *
+         * Each linux::MCP2515 needs its interrupt set up, with
+         * setup_interrupt() or set_interrupt_source(), before add().
+         * While the reactor runs it is the only user of the controllers;
+         * a transmit queue is serviced on each turn, so frames can be
+         * queued from the handler.
+         */
+        class Reactor {
+        public:
+            enum { MaxControllers = 8 };
+
+            explicit Reactor(uint8_t budget = 8);
+            ~Reactor();
+
+            int open(void);
+            void close(void);
+
+            // Returns the controller number passed to the handler, or ERROR
+            int add(
+                linux::MCP2515 *base, wlp::MCP2515 *bus,
+                FrameHandler handler, void *context);
+
+            // Wait up to timeout ms for an interrupt (not at all while a
+            // controller is carried over) and give every ready controller
+            // one turn. When no interrupt came, the others still get
+            // service_errors() and service_transmit() so deadlines and
+            // bus-off recovery advance. Returns the number of controllers
+            // serviced.
+            int run_once(int timeout);
+            // run_once() until stop(), which may be called from any thread
+            int run(int timeout = 100);
+            void stop(void);
+
+            const ReactorStats &stats(uint8_t controller) const;
+
+        private:
+            struct Controller {
+                linux::MCP2515 *base;
+                wlp::MCP2515 *bus;
+                FrameHandler handler;
+                void *context;
+                bool pending;
+                ReactorStats stats;
+            };
+
+            bool service(uint8_t index);
+
+            Controller m_controllers[MaxControllers];
+            uint8_t m_count;
+            uint8_t m_budget;
+            // controller that goes first in the next round
+            uint8_t m_next;
+            uint8_t m_pending;
+            int m_epfd;
+            std::atomic<bool> m_running;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __LINUX_MCP2515_RECEIVER_H__
+#define __LINUX_MCP2515_RECEIVER_H__
+
+#include <sys/mcp2515.h>
+#include <sys/mcp2515_thread.h>
+#include <MCP2515.h>
+#include <pthread.h>
+#include <atomic>
+
+namespace wlp {
+    namespace linux {
+        /**
+         * Receive engine that owns a thread which drains the chip into a
+         * single-producer/single-consumer ring on every interrupt. The
+         * application pops frames without touching SPI.
+         *
+         * While the engine is running, the receiver thread is the only user
+         * of the SPI device; the application must not call into `base` or
+         * `bus` until `stop()` returns.
+         *
+         * With a ThreadConfig the thread can run under SCHED_FIFO, pinned
+         * to a CPU, with memory locked and its stack and rings touched
+         * before the first frame, so draining never page-faults.
+         */
+        class Receiver {
+        public:
+            // capacity must be a power of two; info, when given, is a
+            // parallel ring of capacity entries for per-frame metadata
+            Receiver(
+                linux::MCP2515 *base, wlp::MCP2515 *bus,
+                CanFrame frames[], uint32_t capacity,
+                FrameInfo info[] = nullptr);
+            ~Receiver();
+
+            int start(int timeout = 100, const ThreadConfig *config = nullptr);
+            void stop(void);
+
+            // info is left untouched if the receiver has no info ring
+            bool pop(CanFrame *frame, FrameInfo *info = nullptr);
+            uint32_t available(void) const;
+
+            // frames placed in the ring
+            uint32_t received(void) const;
+            // frames read from the chip but dropped because the ring was full
+            uint32_t dropped(void) const;
+            // frames lost on the chip because RXB0/RXB1 were both full
+            uint32_t overruns(void) const;
+            WakeLatency wake_latency(void) const;
+
+        private:
+            static void *run(void *arg);
+            void drain(void);
+            void record_wake(uint64_t edge);
+
+            linux::MCP2515 *m_base;
+            wlp::MCP2515 *m_bus;
+            CanFrame *m_frames;
+            FrameInfo *m_info;
+            uint32_t m_capacity;
+            int m_timeout;
+            pthread_t m_thread;
+            ThreadConfig m_config;
+            bool m_configured;
+            bool m_started;
+
+            std::atomic<bool> m_running;
+            std::atomic<uint32_t> m_head;
+            std::atomic<uint32_t> m_tail;
+            std::atomic<uint32_t> m_received;
+            std::atomic<uint32_t> m_dropped;
+            std::atomic<uint32_t> m_overruns;
+            std::atomic<uint32_t> m_wakeSamples;
+            std::atomic<uint64_t> m_wakeMin;
+            std::atomic<uint64_t> m_wakeMax;
+            std::atomic<uint64_t> m_wakeTotal;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __LINUX_MCP2515_THREAD_H__
+#define __LINUX_MCP2515_THREAD_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace wlp {
+    namespace linux {
+
+        /*
+         * Scheduling for a receive or service thread; {0, -1, 0, false}
+         * changes nothing. SCHED_FIFO and mlockall() need CAP_SYS_NICE
+         * and CAP_IPC_LOCK (or matching rlimits).
+         */
+        struct ThreadConfig {
+            // SCHED_FIFO priority 1-99, 0 keeps the default policy
+            int priority;
+            // CPU to pin to, -1 for any
+            int cpu;
+            // Stack size in bytes, 0 for the default. All of it but a
+            // small margin, or 64 KiB of a default stack, is touched when
+            // the thread starts.
+            size_t stackSize;
+            // mlockall(MCL_CURRENT | MCL_FUTURE) before the thread starts
+            bool lockMemory;
+        };
+
+        struct WakeLatency {
+            // wakeups with an INT edge
+            uint32_t samples;
+            // ns from the edge to the thread running again. Only the GPIO
+            // character device timestamps the edge itself; with sysfs
+            // this is close to 0.
+            uint64_t min;
+            uint64_t max;
+            uint64_t mean;
+        };
+
+        // pthread_create() with config applied through the thread
+        // attributes, so a refused priority or CPU is reported here
+        int start_thread(
+            pthread_t *thread, const ThreadConfig *config,
+            void *(*entry)(void *), void *arg);
+        // Apply config to the calling thread, e.g. one running a Reactor
+        int configure_thread(const ThreadConfig *config);
+        // Touch the calling thread's stack as described for stackSize,
+        // call first thing in the thread
+        void prefault_stack(const ThreadConfig *config);
+
+    }
+}
+
+#endif
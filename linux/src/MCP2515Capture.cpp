@@ -0,0 +1,272 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/mcp2515_capture.h>
+#include <sys/mcp2515_interrupt.h>
+
+using namespace wlp;
+
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+#ifndef OK
+#define OK 0
+#endif
+
+#if MCP2515_DEBUG_LEVEL >= 1
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+static const char s_magic[8] = {'W', 'L', 'P', 'C', 'A', 'P', 0, 0};
+
+static int write_all(int fd, const void *data, size_t n) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (n > 0) {
+        ssize_t res = write(fd, p, n);
+        if (res < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            dprintf("[ERROR] Capture write failed (%s)\n", strerror(errno));
+            return ERROR;
+        }
+        p += res;
+        n -= res;
+    }
+    return OK;
+}
+
+static uint64_t realtime_ns(void) {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+linux::CaptureWriter::CaptureWriter(CaptureRecord ring[], uint32_t capacity) :
+        m_ring(ring),
+        m_capacity(capacity),
+        m_fd(-1),
+        m_flushInterval(100),
+        m_started(false),
+        m_running(false),
+        m_head(0),
+        m_tail(0),
+        m_written(0),
+        m_dropped(0) {}
+
+linux::CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+int linux::CaptureWriter::open(const char *path, int flushInterval) {
+    if (m_started) {
+        return OK;
+    }
+    if (0 == m_capacity || (m_capacity & (m_capacity - 1))) {
+        dprintf("[ERROR] Capture capacity %u is not a power of two\n", m_capacity);
+        return ERROR;
+    }
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        dprintf("[ERROR] Failed to open capture: %s (%s)\n", path, strerror(errno));
+        return ERROR;
+    }
+    CaptureHeader header = {};
+    memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = CaptureVersion;
+    header.recordSize = sizeof(CaptureRecord);
+    header.startTime = monotonic_ns();
+    header.wallTime = realtime_ns();
+    if (write_all(m_fd, &header, sizeof(header)) == ERROR) {
+        ::close(m_fd);
+        m_fd = -1;
+        return ERROR;
+    }
+
+    m_flushInterval = flushInterval;
+    m_head.store(0);
+    m_tail.store(0);
+    m_running.store(true);
+    int res = pthread_create(&m_thread, nullptr, &CaptureWriter::run, this);
+    if (res) {
+        dprintf("[ERROR] Failed to start capture thread (%s)\n", strerror(res));
+        m_running.store(false);
+        ::close(m_fd);
+        m_fd = -1;
+        return ERROR;
+    }
+    m_started = true;
+    return OK;
+}
+
+int linux::CaptureWriter::close(void) {
+    if (!m_started) {
+        return OK;
+    }
+    m_running.store(false, std::memory_order_release);
+    pthread_join(m_thread, nullptr);
+    m_started = false;
+    int res = OK;
+    if (fdatasync(m_fd)) {
+        dprintf("[ERROR] Capture sync failed (%s)\n", strerror(errno));
+        res = ERROR;
+    }
+    ::close(m_fd);
+    m_fd = -1;
+    return res;
+}
+
+bool linux::CaptureWriter::push(const CanFrame *frame, const FrameInfo *info) {
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    CaptureRecord &record = m_ring[head & (m_capacity - 1)];
+    record = {};
+    record.timestamp = info->timestamp;
+    record.sequence = info->sequence;
+    record.id = frame->id;
+    record.flags = frame->flags;
+    record.dlc = frame->dlc;
+    memcpy(record.data, frame->data, sizeof(record.data));
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+uint64_t linux::CaptureWriter::written(void) const {
+    return m_written.load(std::memory_order_relaxed);
+}
+
+uint32_t linux::CaptureWriter::dropped(void) const {
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void *linux::CaptureWriter::run(void *arg) {
+    CaptureWriter *self = static_cast<CaptureWriter *>(arg);
+    uint64_t interval = self->m_flushInterval * 1000000ull;
+    uint64_t last = monotonic_ns();
+    while (true) {
+        // Read the flag first so the final flush sees every push
+        bool running = self->m_running.load(std::memory_order_acquire);
+        uint32_t head = self->m_head.load(std::memory_order_acquire);
+        uint32_t pending = head - self->m_tail.load(std::memory_order_relaxed);
+        uint64_t now = monotonic_ns();
+        if (!running || pending >= BatchRecords ||
+                (0 != pending && now - last >= interval)) {
+            self->flush(head);
+            last = now;
+        }
+        if (!running) {
+            return nullptr;
+        }
+        if (pending < BatchRecords) {
+            usleep(1000);
+        }
+    }
+}
+
+void linux::CaptureWriter::flush(uint32_t head) {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    while (tail != head) {
+        // The ring wraps at most once, so this writes one or two runs
+        uint32_t index = tail & (m_capacity - 1);
+        uint32_t n = head - tail;
+        if (n > m_capacity - index) {
+            n = m_capacity - index;
+        }
+        if (write_all(m_fd, &m_ring[index], n * sizeof(CaptureRecord)) == ERROR) {
+            m_dropped.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            m_written.fetch_add(n, std::memory_order_relaxed);
+        }
+        tail += n;
+        m_tail.store(tail, std::memory_order_release);
+    }
+}
+
+linux::CaptureReader::CaptureReader() :
+        m_fd(-1),
+        m_map(MAP_FAILED),
+        m_length(0),
+        m_count(0) {}
+
+linux::CaptureReader::~CaptureReader() {
+    close();
+}
+
+int linux::CaptureReader::open(const char *path) {
+    close();
+    m_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        dprintf("[ERROR] Failed to open capture: %s (%s)\n", path, strerror(errno));
+        return ERROR;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) || (size_t) st.st_size < sizeof(CaptureHeader)) {
+        dprintf("[ERROR] %s is not a capture\n", path);
+        close();
+        return ERROR;
+    }
+    m_length = st.st_size;
+    m_map = mmap(nullptr, m_length, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (MAP_FAILED == m_map) {
+        dprintf("[ERROR] Failed to map capture (%s)\n", strerror(errno));
+        close();
+        return ERROR;
+    }
+    const CaptureHeader *h = header();
+    if (memcmp(h->magic, s_magic, sizeof(s_magic)) ||
+            CaptureVersion != h->version ||
+            sizeof(CaptureRecord) != h->recordSize) {
+        dprintf("[ERROR] %s is not a version %d capture\n", path, CaptureVersion);
+        close();
+        return ERROR;
+    }
+    madvise(m_map, m_length, MADV_SEQUENTIAL);
+    m_count = (m_length - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+    return OK;
+}
+
+void linux::CaptureReader::close(void) {
+    if (MAP_FAILED != m_map) {
+        munmap(m_map, m_length);
+        m_map = MAP_FAILED;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_length = 0;
+    m_count = 0;
+}
+
+const linux::CaptureHeader *linux::CaptureReader::header(void) const {
+    if (MAP_FAILED == m_map) {
+        return nullptr;
+    }
+    return static_cast<const CaptureHeader *>(m_map);
+}
+
+const linux::CaptureRecord *linux::CaptureReader::begin(void) const {
+    if (MAP_FAILED == m_map) {
+        return nullptr;
+    }
+    return reinterpret_cast<const CaptureRecord *>(header() + 1);
+}
+
+const linux::CaptureRecord *linux::CaptureReader::end(void) const {
+    return begin() + m_count;
+}
+
+uint64_t linux::CaptureReader::size(void) const {
+    return m_count;
+}
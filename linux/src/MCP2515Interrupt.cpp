@@ -0,0 +1,171 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+#include <sys/mcp2515_interrupt.h>
+
+using namespace wlp;
+
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+#ifndef OK
+#define OK 0
+#endif
+
+#if MCP2515_DEBUG_LEVEL >= 1
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+static int poll_readable(int fd, int timeout) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    int res;
+    do {
+        res = poll(&pfd, 1, timeout);
+    } while (res < 0 && EINTR == errno);
+    if (res < 0) {
+        dprintf("[ERROR] Poll failed (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    return res;
+}
+
+uint64_t linux::monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+linux::GpioInterrupt::GpioInterrupt() :
+        m_fd(-1) {}
+
+linux::GpioInterrupt::~GpioInterrupt() {
+    close();
+}
+
+int linux::GpioInterrupt::open(const char *chip, uint32_t line) {
+    close();
+    int chipfd = ::open(chip, O_RDONLY | O_CLOEXEC);
+    if (chipfd < 0) {
+        dprintf("[ERROR] Failed to open: %s (%s)\n", chip, strerror(errno));
+        return ERROR;
+    }
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    strncpy(req.consumer, "mcp2515", sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    int res = ioctl(chipfd, GPIO_V2_GET_LINE_IOCTL, &req);
+    ::close(chipfd);
+    if (res < 0) {
+        dprintf("[ERROR] Failed to request line %u (%s)\n", line, strerror(errno));
+        return ERROR;
+    }
+    m_fd = req.fd;
+    return OK;
+}
+
+void linux::GpioInterrupt::close(void) {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+int linux::GpioInterrupt::wait(InterruptEvent events[], int max, int timeout) {
+    int res = poll_readable(m_fd, timeout);
+    if (res <= 0) {
+        return res;
+    }
+    struct gpio_v2_line_event raw[MaxEvents];
+    if (max > MaxEvents) {
+        max = MaxEvents;
+    }
+    ssize_t len = read(m_fd, raw, max * sizeof(raw[0]));
+    if (len < 0) {
+        dprintf("[ERROR] Failed to read line events (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    int n = len / sizeof(raw[0]);
+    for (int i = 0; i < n; ++i) {
+        events[i].timestamp = raw[i].timestamp_ns;
+        events[i].sequence = raw[i].line_seqno;
+    }
+    return n;
+}
+
+int linux::GpioInterrupt::fd(void) const {
+    return m_fd;
+}
+
+linux::EventInterrupt::EventInterrupt() :
+        m_fd(-1),
+        m_sequence(0),
+        m_last(0) {}
+
+linux::EventInterrupt::~EventInterrupt() {
+    close();
+}
+
+int linux::EventInterrupt::open(void) {
+    close();
+    m_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_fd < 0) {
+        dprintf("[ERROR] Failed to create eventfd (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    m_sequence = 0;
+    return OK;
+}
+
+void linux::EventInterrupt::close(void) {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+int linux::EventInterrupt::trigger(void) {
+    m_last.store(monotonic_ns(), std::memory_order_relaxed);
+    uint64_t one = 1;
+    if (write(m_fd, &one, sizeof(one)) != sizeof(one)) {
+        dprintf("[ERROR] Failed to signal eventfd (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    return OK;
+}
+
+int linux::EventInterrupt::wait(InterruptEvent events[], int max, int timeout) {
+    int res = poll_readable(m_fd, timeout);
+    if (res <= 0) {
+        return res;
+    }
+    uint64_t count;
+    if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+        // another reader took it first
+        return 0;
+    }
+    if (max < 1) {
+        return 0;
+    }
+    m_sequence += count;
+    events[0].timestamp = m_last.load(std::memory_order_relaxed);
+    events[0].sequence = m_sequence;
+    return 1;
+}
+
+int linux::EventInterrupt::fd(void) const {
+    return m_fd;
+}
@@ -27,13 +27,18 @@ extern "C" int printf(const char *msg, ...);
 #define dprintf(...)
 #endif
 
-static void spi_process_transfers(int fd, spi_ioc_transfer *buf, uint8_t n) {
-    int status = ioctl(fd, SPI_IOC_MESSAGE(n), buf);
-    size_t len = buf[0].len;
-    if (2 == n) {
-        len += buf[1].len;
+void linux::MCP2515::transfer(spi_ioc_transfer *buf, uint8_t n, uint8_t transactions) {
+    int status = ioctl(m_fd, SPI_IOC_MESSAGE(n), buf);
+    int len = 0;
+    for (uint8_t i = 0; i < n; ++i) {
+        len += buf[i].len;
     }
+    // transactions is only counted with MCP2515_STATS
+    (void) transactions;
+    MCP2515_STAT(m_stats.transactions += transactions;)
+    MCP2515_STAT(m_stats.bytes += len;)
     if (status != len) {
+        MCP2515_STAT(++m_stats.transferErrors;)
         if (status < 0) {
             dprintf("[ERROR] SPI failed transfer (%s)\n", strerror(errno));
         } else {
@@ -42,26 +47,23 @@ static void spi_process_transfers(int fd, spi_ioc_transfer *buf, uint8_t n) {
     }
 }
 
-static void spi_transfer1(
-        int fd, spi_ioc_transfer *buf,
-        uint8_t tx[], uint8_t rx[], uint32_t n) {
-    buf[0].tx_buf = (uint64_t) tx;
-    buf[0].rx_buf = (uint64_t) rx;
-    buf[0].len = n;
-    spi_process_transfers(fd, buf, 1);
+void linux::MCP2515::transfer1(uint8_t tx[], uint8_t rx[], uint32_t n) {
+    m_spiBuffer[0].tx_buf = (uint64_t) tx;
+    m_spiBuffer[0].rx_buf = (uint64_t) rx;
+    m_spiBuffer[0].len = n;
+    transfer(m_spiBuffer, 1, 1);
 }
 
-static void spi_transfer2(
-        int fd, spi_ioc_transfer *buf,
+void linux::MCP2515::transfer2(
         uint8_t tx1[], uint8_t rx1[], uint32_t n1,
         uint8_t tx2[], uint8_t rx2[], uint32_t n2) {
-    buf[0].tx_buf = (uint64_t) tx1;
-    buf[0].rx_buf = (uint64_t) rx1;
-    buf[0].len = n1;
-    buf[1].tx_buf = (uint64_t) tx2;
-    buf[1].rx_buf = (uint64_t) rx2;
-    buf[1].len = n2;
-    spi_process_transfers(fd, buf, 2);
+    m_spiBuffer[0].tx_buf = (uint64_t) tx1;
+    m_spiBuffer[0].rx_buf = (uint64_t) rx1;
+    m_spiBuffer[0].len = n1;
+    m_spiBuffer[1].tx_buf = (uint64_t) tx2;
+    m_spiBuffer[1].rx_buf = (uint64_t) rx2;
+    m_spiBuffer[1].len = n2;
+    transfer(m_spiBuffer, 2, 1);
 }
 
 linux::MCP2515::MCP2515(const char *dev, int busSpeed) :
@@ -71,7 +73,11 @@ linux::MCP2515::MCP2515(const char *dev, int busSpeed) :
         m_mode(0),
         m_lsbFirst(0),
         m_fd(-1),
-        m_intfd(-1) {
+        m_intfd(-1),
+        m_source(nullptr),
+        m_interruptTime(0),
+        m_edgePending(false),
+        m_edgeBuffers(0) {
     m_pfd.fd = -1;
     m_spiBuffer[0] = {};
     m_spiBuffer[0].speed_hz = m_speed;
@@ -79,6 +85,12 @@ linux::MCP2515::MCP2515(const char *dev, int busSpeed) :
     m_spiBuffer[1] = {};
     m_spiBuffer[1].speed_hz = m_speed;
     m_spiBuffer[1].bits_per_word = m_bitsPerWord;
+    for (uint8_t i = 0; i < MaxTransfers; ++i) {
+        m_batch[i] = {};
+        m_batch[i].speed_hz = m_speed;
+        m_batch[i].bits_per_word = m_bitsPerWord;
+    }
+    clear_stats();
 }
 
 static int file_printf(const char *file, const char *format, ...) {
@@ -146,11 +158,35 @@ int linux::MCP2515::setup_interrupt(int gpio) {
     return OK;
 }
 
+void linux::MCP2515::set_interrupt_source(InterruptSource *source) {
+    m_source = source;
+}
+
 int linux::MCP2515::wait_interrupt(int timeout) {
-    if(poll(&m_pfd, 1, timeout) < 0) {
+    if (nullptr != m_source) {
+        InterruptEvent events[MaxEvents];
+        int n = m_source->wait(events, MaxEvents, timeout);
+        if (n < 0) {
+            return ERROR;
+        }
+        if (n > 0) {
+            m_interruptTime = events[0].timestamp;
+            m_edgePending = true;
+            MCP2515_STAT(count_interrupt();)
+        }
+        return OK;
+    }
+
+    int res = poll(&m_pfd, 1, timeout);
+    if(res < 0) {
         dprintf("[ERROR] Poll failed (%s)\n", strerror(errno));
         return ERROR;
     }
+    if (res > 0) {
+        m_interruptTime = monotonic_ns();
+        m_edgePending = true;
+        MCP2515_STAT(count_interrupt();)
+    }
 
     lseek(m_intfd, 0, SEEK_SET);
     read(m_intfd, m_garbage, sizeof(m_garbage));
@@ -158,6 +194,61 @@ int linux::MCP2515::wait_interrupt(int timeout) {
     return OK;
 }
 
+uint64_t linux::MCP2515::interrupt_time(void) const {
+    return m_interruptTime;
+}
+
+int linux::MCP2515::interrupt_fd(void) const {
+    return nullptr != m_source ? m_source->fd() : m_intfd;
+}
+
+uint64_t linux::MCP2515::receive_time(uint8_t rxBuf) {
+    if (m_edgePending) {
+        m_edgePending = false;
+        m_edgeBuffers = 0x03;
+    }
+    uint8_t bit = 1 << rxBuf;
+    if (m_edgeBuffers & bit) {
+        m_edgeBuffers &= ~bit;
+        return m_interruptTime;
+    }
+    return monotonic_ns();
+}
+
+uint64_t linux::MCP2515::now(void) {
+    return monotonic_ns();
+}
+
+void linux::MCP2515::stats(BackendStats *snapshot) const {
+#if MCP2515_STATS
+    *snapshot = m_stats;
+#else
+    *snapshot = BackendStats();
+#endif
+}
+
+void linux::MCP2515::clear_stats(void) {
+#if MCP2515_STATS
+    m_stats = BackendStats();
+    m_unreadEdge = 0;
+#endif
+}
+
+#if MCP2515_STATS
+void linux::MCP2515::count_interrupt(void) {
+    ++m_stats.interrupts;
+    m_unreadEdge = m_interruptTime;
+}
+
+void linux::MCP2515::record_read(void) {
+    if (0 != m_unreadEdge) {
+        uint64_t now = monotonic_ns();
+        m_stats.interruptToRead.record(now > m_unreadEdge ? now - m_unreadEdge : 0);
+        m_unreadEdge = 0;
+    }
+}
+#endif
+
 int linux::MCP2515::begin(void) {
     m_fd = open(m_dev, O_RDWR);
     if (m_fd < 0) {
@@ -185,45 +276,104 @@ int linux::MCP2515::begin(void) {
 
 void linux::MCP2515::reset(void) {
     uint8_t ins = Instruction::Reset;
-    spi_transfer1(m_fd, m_spiBuffer, &ins, nullptr, 1);
+    transfer1(&ins, nullptr, 1);
 }
 
 uint8_t linux::MCP2515::read_status(void) {
+    // A read starts with the status, the edge only covers the one after it
+    m_edgeBuffers = 0;
     uint8_t tx[2] = {Instruction::ReadStatus, Instruction::Fetch};
     uint8_t rx[2];
-    spi_transfer1(m_fd, m_spiBuffer, tx, rx, 2);
+    transfer1(tx, rx, 2);
     return rx[1];
 }
 
 uint8_t linux::MCP2515::read_register(uint8_t address) {
     uint8_t tx[3] = {Instruction::Read, address, Instruction::Fetch};
     uint8_t rx[3];
-    spi_transfer1(m_fd, m_spiBuffer, tx, rx, 3);
+    transfer1(tx, rx, 3);
     return rx[2];
 }
 
 void linux::MCP2515::read_registers(uint8_t address, uint8_t values[], uint8_t n) {
     uint8_t tx[2] = {Instruction::Read, address};
-    spi_transfer2(
-        m_fd, m_spiBuffer,
+    transfer2(
         tx, nullptr, 2,
         nullptr, values, n);
 }
 
 void linux::MCP2515::set_register(uint8_t address, uint8_t value) {
     uint8_t tx[3] = {Instruction::Write, address, value};
-    spi_transfer1(m_fd, m_spiBuffer, tx, nullptr, 3);
+    transfer1(tx, nullptr, 3);
 }
 
 void linux::MCP2515::set_registers(uint8_t address, uint8_t values[], uint8_t n) {
     uint8_t tx[2] = {Instruction::Write, address};
-    spi_transfer2(
-        m_fd, m_spiBuffer,
+    transfer2(
         tx, nullptr, 2,
         values, nullptr, n);
 }
 
 void linux::MCP2515::modify_register(uint8_t address, uint8_t mask, uint8_t data) {
     uint8_t tx[4] = {Instruction::Modify, address, mask, data};
-    spi_transfer1(m_fd, m_spiBuffer, tx, nullptr, 4);
+    transfer1(tx, nullptr, 4);
+}
+
+void linux::MCP2515::read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    transfer2(
+        &instruction, nullptr, 1,
+        nullptr, values, n);
+    MCP2515_STAT(record_read();)
+}
+
+void linux::MCP2515::load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    transfer2(
+        &instruction, nullptr, 1,
+        values, nullptr, n);
+}
+
+void linux::MCP2515::request_to_send(uint8_t instruction) {
+    transfer1(&instruction, nullptr, 1);
+}
+
+void linux::MCP2515::execute(CommandList &list) {
+    // Every command becomes a header transfer plus an optional payload
+    // transfer; cs_change on the last transfer of each command releases
+    // chip-select before the next one, all within one SPI_IOC_MESSAGE.
+    uint8_t n = 0;
+    uint8_t commands = 0;
+    MCP2515_STAT(bool reads = false;)
+    for (uint8_t i = 0; i < list.size(); ++i) {
+        Command &cmd = list[i];
+        uint8_t segments = cmd.length ? 2 : 1;
+        if (n + segments > MaxTransfers) {
+            m_batch[n - 1].cs_change = 0;
+            transfer(m_batch, n, commands);
+            n = 0;
+            commands = 0;
+        }
+        MCP2515_STAT(reads |= Instruction::ReadRX == (cmd.header[0] & 0xF9);)
+        m_batch[n].tx_buf = (uint64_t) cmd.header;
+        m_batch[n].rx_buf = 0;
+        m_batch[n].len = cmd.headerLength;
+        m_batch[n].cs_change = 0;
+        ++n;
+        if (cmd.length) {
+            m_batch[n].tx_buf = (uint64_t) cmd.tx;
+            m_batch[n].rx_buf = (uint64_t) cmd.rx;
+            m_batch[n].len = cmd.length;
+            ++n;
+        }
+        m_batch[n - 1].cs_change = 1;
+        ++commands;
+    }
+    if (n) {
+        m_batch[n - 1].cs_change = 0;
+        transfer(m_batch, n, commands);
+    }
+#if MCP2515_STATS
+    if (reads) {
+        record_read();
+    }
+#endif
 }
@@ -0,0 +1,187 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mcp2515_reactor.h>
+
+using namespace wlp;
+
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+#ifndef OK
+#define OK 0
+#endif
+
+#if MCP2515_DEBUG_LEVEL >= 1
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+linux::Reactor::Reactor(uint8_t budget) :
+        m_count(0),
+        m_budget(budget > 0 ? budget : 1),
+        m_next(0),
+        m_pending(0),
+        m_epfd(-1),
+        m_running(false) {}
+
+linux::Reactor::~Reactor() {
+    close();
+}
+
+int linux::Reactor::open(void) {
+    if (m_epfd >= 0) {
+        return OK;
+    }
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd < 0) {
+        dprintf("[ERROR] Failed to create epoll instance (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    return OK;
+}
+
+void linux::Reactor::close(void) {
+    if (m_epfd >= 0) {
+        ::close(m_epfd);
+        m_epfd = -1;
+    }
+    m_count = 0;
+    m_next = 0;
+    m_pending = 0;
+}
+
+int linux::Reactor::add(
+        linux::MCP2515 *base, wlp::MCP2515 *bus,
+        FrameHandler handler, void *context) {
+    if (m_epfd < 0 || m_count >= MaxControllers) {
+        dprintf("[ERROR] Reactor is not open or full\n");
+        return ERROR;
+    }
+    int fd = base->interrupt_fd();
+    if (fd < 0) {
+        dprintf("[ERROR] Controller has no interrupt set up\n");
+        return ERROR;
+    }
+    // GPIO character devices and eventfds become readable, sysfs value
+    // files signal POLLPRI
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLPRI;
+    ev.data.u32 = m_count;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev)) {
+        dprintf("[ERROR] Failed to watch interrupt fd (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    Controller &c = m_controllers[m_count];
+    c.base = base;
+    c.bus = bus;
+    c.handler = handler;
+    c.context = context;
+    // Frames may already be waiting from before the reactor started
+    c.pending = true;
+    c.stats = ReactorStats();
+    ++m_pending;
+    return m_count++;
+}
+
+int linux::Reactor::run_once(int timeout) {
+    struct epoll_event events[MaxControllers];
+    int n;
+    do {
+        n = epoll_wait(m_epfd, events, MaxControllers, m_pending ? 0 : timeout);
+    } while (n < 0 && EINTR == errno);
+    if (n < 0) {
+        dprintf("[ERROR] epoll_wait failed (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    for (int i = 0; i < n; ++i) {
+        Controller &c = m_controllers[events[i].data.u32];
+        // Consume the edge so the descriptor is quiet until the next one
+        c.base->wait_interrupt(0);
+        if (!c.pending) {
+            c.pending = true;
+            ++m_pending;
+        }
+    }
+    if (0 == n) {
+        // Nothing fired, but transmit deadlines and a bus-off restart
+        // move with the clock and would otherwise wait for the next edge
+        for (uint8_t i = 0; i < m_count; ++i) {
+            Controller &c = m_controllers[i];
+            if (!c.pending) {
+                c.bus->service_errors();
+                c.bus->service_transmit();
+            }
+        }
+    }
+
+    int serviced = 0;
+    uint8_t first = m_next;
+    for (uint8_t k = 0; k < m_count; ++k) {
+        uint8_t index = (first + k) % m_count;
+        if (!m_controllers[index].pending) {
+            continue;
+        }
+        ++serviced;
+        if (!service(index)) {
+            m_controllers[index].pending = false;
+            --m_pending;
+        }
+    }
+    // Rotate who goes first so equal loads share the SPI bus evenly
+    if (m_count > 0) {
+        m_next = (first + 1) % m_count;
+    }
+    return serviced;
+}
+
+int linux::Reactor::run(int timeout) {
+    m_running.store(true, std::memory_order_relaxed);
+    while (m_running.load(std::memory_order_relaxed)) {
+        if (run_once(timeout) == ERROR) {
+            return ERROR;
+        }
+    }
+    return OK;
+}
+
+void linux::Reactor::stop(void) {
+    m_running.store(false, std::memory_order_relaxed);
+}
+
+const linux::ReactorStats &linux::Reactor::stats(uint8_t controller) const {
+    return m_controllers[controller].stats;
+}
+
+bool linux::Reactor::service(uint8_t index) {
+    Controller &c = m_controllers[index];
+    CanFrame frames[2];
+    FrameInfo info[2];
+    uint8_t taken = 0;
+    while (taken < m_budget) {
+        uint8_t max = m_budget - taken < 2 ? m_budget - taken : 2;
+        uint8_t n = c.bus->read_frames(frames, max, info);
+        if (0 == n) {
+            uint8_t overflow = c.bus->clear_overflow();
+            c.stats.overruns += overflow;
+            // Only an edge marks the controller pending, so every enabled
+            // flag has to be cleared here: ERRIF, and TXnIF when a
+            // transmit queue is set
+            c.bus->service_errors();
+            c.bus->service_transmit();
+            // A flag raised since the status read, e.g. by a refilled
+            // buffer that went out at once, keeps INT low without a new
+            // edge, so the controller stays pending until none is left
+            return 0 != c.bus->pending_interrupts();
+        }
+        c.handler(c.context, index, frames, info, n);
+        c.stats.received += n;
+        taken += n;
+    }
+    ++c.stats.deferred;
+    return true;
+}
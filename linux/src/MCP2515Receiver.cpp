@@ -0,0 +1,191 @@
+#include <string.h>
+#include <stdio.h>
+#include <sys/mcp2515_receiver.h>
+
+using namespace wlp;
+
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+#ifndef OK
+#define OK 0
+#endif
+
+#if MCP2515_DEBUG_LEVEL >= 1
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+linux::Receiver::Receiver(
+        linux::MCP2515 *base, wlp::MCP2515 *bus,
+        CanFrame frames[], uint32_t capacity,
+        FrameInfo info[]) :
+        m_base(base),
+        m_bus(bus),
+        m_frames(frames),
+        m_info(info),
+        m_capacity(capacity),
+        m_timeout(100),
+        m_config(),
+        m_configured(false),
+        m_started(false),
+        m_running(false),
+        m_head(0),
+        m_tail(0),
+        m_received(0),
+        m_dropped(0),
+        m_overruns(0),
+        m_wakeSamples(0),
+        m_wakeMin(UINT64_MAX),
+        m_wakeMax(0),
+        m_wakeTotal(0) {}
+
+linux::Receiver::~Receiver() {
+    stop();
+}
+
+int linux::Receiver::start(int timeout, const ThreadConfig *config) {
+    if (m_started) {
+        return OK;
+    }
+    if (0 == m_capacity || (m_capacity & (m_capacity - 1))) {
+        dprintf("[ERROR] Receiver capacity %u is not a power of two\n", m_capacity);
+        return ERROR;
+    }
+    m_timeout = timeout;
+    m_configured = nullptr != config;
+    if (m_configured) {
+        m_config = *config;
+        // Fault the rings in now rather than on the first frames
+        memset(m_frames, 0, m_capacity * sizeof(CanFrame));
+        if (nullptr != m_info) {
+            memset(m_info, 0, m_capacity * sizeof(FrameInfo));
+        }
+    }
+    m_running.store(true);
+    if (start_thread(&m_thread, config, &Receiver::run, this) == ERROR) {
+        dprintf("[ERROR] Failed to start receiver thread\n");
+        m_running.store(false);
+        return ERROR;
+    }
+    m_started = true;
+    return OK;
+}
+
+void linux::Receiver::stop(void) {
+    if (!m_started) {
+        return;
+    }
+    m_running.store(false);
+    pthread_join(m_thread, nullptr);
+    m_started = false;
+}
+
+bool linux::Receiver::pop(CanFrame *frame, FrameInfo *info) {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *frame = m_frames[tail & (m_capacity - 1)];
+    if (nullptr != info && nullptr != m_info) {
+        *info = m_info[tail & (m_capacity - 1)];
+    }
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t linux::Receiver::available(void) const {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+}
+
+uint32_t linux::Receiver::received(void) const {
+    return m_received.load(std::memory_order_relaxed);
+}
+
+uint32_t linux::Receiver::dropped(void) const {
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+uint32_t linux::Receiver::overruns(void) const {
+    return m_overruns.load(std::memory_order_relaxed);
+}
+
+linux::WakeLatency linux::Receiver::wake_latency(void) const {
+    WakeLatency latency = {};
+    latency.samples = m_wakeSamples.load(std::memory_order_relaxed);
+    if (0 != latency.samples) {
+        latency.min = m_wakeMin.load(std::memory_order_relaxed);
+        latency.max = m_wakeMax.load(std::memory_order_relaxed);
+        latency.mean = m_wakeTotal.load(std::memory_order_relaxed) / latency.samples;
+    }
+    return latency;
+}
+
+void *linux::Receiver::run(void *arg) {
+    Receiver *self = static_cast<Receiver *>(arg);
+    if (self->m_configured) {
+        prefault_stack(&self->m_config);
+    }
+    while (self->m_running.load(std::memory_order_relaxed)) {
+        uint64_t last = self->m_base->interrupt_time();
+        self->m_base->wait_interrupt(self->m_timeout);
+        uint64_t edge = self->m_base->interrupt_time();
+        if (edge != last) {
+            self->record_wake(edge);
+        }
+        self->drain();
+    }
+    return nullptr;
+}
+
+void linux::Receiver::record_wake(uint64_t edge) {
+    // Only this thread writes, the atomics just keep readers tear-free
+    uint64_t now = monotonic_ns();
+    uint64_t latency = now > edge ? now - edge : 0;
+    if (latency < m_wakeMin.load(std::memory_order_relaxed)) {
+        m_wakeMin.store(latency, std::memory_order_relaxed);
+    }
+    if (latency > m_wakeMax.load(std::memory_order_relaxed)) {
+        m_wakeMax.store(latency, std::memory_order_relaxed);
+    }
+    m_wakeTotal.fetch_add(latency, std::memory_order_relaxed);
+    m_wakeSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void linux::Receiver::drain(void) {
+    CanFrame batch[2];
+    FrameInfo info[2];
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+    uint8_t n;
+    while (0 != (n = m_bus->read_frames(batch, 2, nullptr != m_info ? info : nullptr))) {
+        for (uint8_t i = 0; i < n; ++i) {
+            if (head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            m_frames[head & (m_capacity - 1)] = batch[i];
+            if (nullptr != m_info) {
+                m_info[head & (m_capacity - 1)] = info[i];
+            }
+            ++head;
+            m_head.store(head, std::memory_order_release);
+            m_received.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    // Receive overflows and error state changes both raise ERRIF, so
+    // EFLG and the counters are only read when it is set. A pending
+    // bus-off restart is driven from here as well, wait timeouts
+    // included.
+    if (!(m_bus->interrupt_flags() & InterruptFlag::Error) &&
+        BusState::BusOff != m_bus->bus_errors().state) {
+        return;
+    }
+    uint8_t overflow = m_bus->clear_overflow();
+    if (overflow) {
+        m_overruns.fetch_add(overflow, std::memory_order_relaxed);
+    }
+    m_bus->service_errors();
+}
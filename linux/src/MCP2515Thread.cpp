@@ -0,0 +1,126 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <alloca.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/mcp2515_thread.h>
+
+using namespace wlp;
+
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+#ifndef OK
+#define OK 0
+#endif
+
+#if MCP2515_DEBUG_LEVEL >= 1
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+enum {
+    PageSize = 4096,
+    // Left untouched for the frames already on the stack
+    StackMargin = 16 * 1024,
+    DefaultPrefault = 64 * 1024,
+};
+
+static int lock_memory(const linux::ThreadConfig *config) {
+    if (!config->lockMemory) {
+        return OK;
+    }
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        dprintf("[ERROR] mlockall failed (%s)\n", strerror(errno));
+        return ERROR;
+    }
+    return OK;
+}
+
+int linux::start_thread(
+        pthread_t *thread, const ThreadConfig *config,
+        void *(*entry)(void *), void *arg) {
+    if (nullptr == config) {
+        int res = pthread_create(thread, nullptr, entry, arg);
+        return res ? ERROR : OK;
+    }
+    if (lock_memory(config) == ERROR) {
+        return ERROR;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    int res = 0;
+    if (config->stackSize > 0) {
+        res = pthread_attr_setstacksize(&attr, config->stackSize);
+    }
+    if (!res && config->priority > 0) {
+        sched_param param = {};
+        param.sched_priority = config->priority;
+        res = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        if (!res) {
+            res = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        }
+        if (!res) {
+            res = pthread_attr_setschedparam(&attr, &param);
+        }
+    }
+    if (!res && config->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+        res = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    if (!res) {
+        res = pthread_create(thread, &attr, entry, arg);
+    }
+    pthread_attr_destroy(&attr);
+    if (res) {
+        dprintf("[ERROR] Failed to start thread (%s)\n", strerror(res));
+        return ERROR;
+    }
+    return OK;
+}
+
+int linux::configure_thread(const ThreadConfig *config) {
+    if (lock_memory(config) == ERROR) {
+        return ERROR;
+    }
+    if (config->priority > 0) {
+        sched_param param = {};
+        param.sched_priority = config->priority;
+        int res = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (res) {
+            dprintf("[ERROR] Failed to set SCHED_FIFO (%s)\n", strerror(res));
+            return ERROR;
+        }
+    }
+    if (config->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+        int res = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (res) {
+            dprintf("[ERROR] Failed to pin thread to CPU %d (%s)\n", config->cpu, strerror(res));
+            return ERROR;
+        }
+    }
+    prefault_stack(config);
+    return OK;
+}
+
+void linux::prefault_stack(const ThreadConfig *config) {
+    if (nullptr == config) {
+        return;
+    }
+    size_t bytes = DefaultPrefault;
+    if (config->stackSize > 0) {
+        bytes = config->stackSize > StackMargin ? config->stackSize - StackMargin : 0;
+    }
+    volatile uint8_t *stack = static_cast<volatile uint8_t *>(alloca(bytes));
+    for (size_t i = 0; i < bytes; i += PageSize) {
+        stack[i] = 0;
+    }
+}
@@ -1,5 +1,7 @@
 #include <sys/mcp2515.h>
+#include <sys/mcp2515_capture.h>
 #include <stdio.h>
+#include <unistd.h>
 
 wlp::linux::MCP2515 bus("/dev/spidev0.0", 10000000);
 
@@ -16,4 +18,42 @@ int main(void) {
     uint8_t mode = bus.read_register(Control) & Mode;
     printf("Mode readback: %d\n", mode);
     printf("Expected: %d\n", Config & Mode);
+
+    uint8_t batched = 0;
+    wlp::CommandBuffer<3> list;
+    list.modify(Control, Mode, 0);
+    list.modify(Control, Mode, Config);
+    list.read(Control, &batched, 1);
+    bus.execute(list);
+    printf("Batched mode readback: %d\n", batched & Mode);
+
+    wlp::linux::EventInterrupt interrupt;
+    interrupt.open();
+    bus.set_interrupt_source(&interrupt);
+    printf("Timeout returns: %d\n", bus.wait_interrupt(0));
+    interrupt.trigger();
+    interrupt.trigger();
+    bus.wait_interrupt(100);
+    printf("Edge latency: %llu ns\n",
+           (unsigned long long) (wlp::linux::monotonic_ns() - bus.interrupt_time()));
+
+    static wlp::linux::CaptureRecord ring[64];
+    wlp::linux::CaptureWriter writer(ring, 64);
+    writer.open("/tmp/mcp2515_capture.bin");
+    for (uint32_t i = 0; i < 1000; ++i) {
+        wlp::CanFrame frame = {i & 0x7FF, 0, 1, {(uint8_t) i}};
+        wlp::FrameInfo info = {wlp::linux::monotonic_ns(), i};
+        while (!writer.push(&frame, &info)) {
+            usleep(100);
+        }
+    }
+    writer.close();
+    wlp::linux::CaptureReader reader;
+    reader.open("/tmp/mcp2515_capture.bin");
+    uint32_t matched = 0;
+    for (const wlp::linux::CaptureRecord &r : reader) {
+        matched += r.sequence == matched && r.id == (matched & 0x7FF);
+    }
+    printf("Capture records: %llu written, %u read back in order\n",
+           (unsigned long long) writer.written(), matched);
 }
@@ -0,0 +1,178 @@
+#include <sim/mcp2515.h>
+#include <sim/counter.h>
+#include <MCP2515.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+using namespace wlp;
+
+/*
+ * Driver benchmarks. Each case runs one front-end operation against the
+ * register simulator through a sim::Counter and prints one CSV row with
+ * the per-operation cost:
+ *
+ *   case,iterations,calls,transactions,acquires,bytes,ns,spi_limit
+ *
+ * calls are MCP2515Base entry points, transactions are chip-select
+ * cycles, acquires are bus acquisitions (SPI::acquire() on Cosa), bytes
+ * are clocked over SPI and spi_limit is the operation rate
+ * the SPI clock alone would allow. ns covers the driver and the
+ * simulated chip; setup such as injecting the frame to receive is not
+ * timed or counted.
+ *
+ * usage: sim_bench [spi clock in Hz] [iterations]
+ */
+
+struct Bench {
+    sim::MCP2515 chip;
+    sim::Counter counter;
+    MCP2515 bus;
+    TransmitEntry entries[4];
+    CanFrame frame;
+    uint8_t data[8];
+    uint32_t n;
+
+    Bench() :
+        counter(&chip),
+        bus(&counter),
+        frame({0x15, 0, 8, {0}}),
+        data{0},
+        n(0) {}
+};
+
+typedef void (*Step)(Bench *b);
+
+struct Case {
+    const char *name;
+    Step setup;
+    Step run;
+    bool queued;
+};
+
+static void begin(Bench *b) {
+    b->bus.begin(CAN_500KBPS, MCP_8MHz);
+}
+
+static void set_filter(Bench *b) {
+    // alternate the value so the register shadow cannot skip the write
+    b->bus.set_filter(b->n % 6, b->n & 0x7FF);
+}
+
+static void set_mask(Bench *b) {
+    b->bus.set_mask(b->n & 0x01, b->n & 0x7FF);
+}
+
+static void send_buffer(Bench *b) {
+    b->bus.send_buffer(0x15, 8, b->data);
+}
+
+static void try_send(Bench *b) {
+    b->bus.try_send(&b->frame, 0);
+}
+
+static void queue_send(Bench *b) {
+    b->bus.queue_send(&b->frame, 0);
+    b->bus.service_transmit();
+}
+
+static void inject(Bench *b) {
+    b->chip.inject(&b->frame);
+}
+
+static void inject_pair(Bench *b) {
+    b->chip.modify_register(
+        Register::RXB0CTRL,
+        RXControlMask::AcceptBUKT,
+        RXControlMask::AcceptBUKT);
+    b->chip.inject(&b->frame);
+    b->chip.inject(&b->frame);
+}
+
+static void read_buffer(Bench *b) {
+    b->bus.read_buffer(8, b->data);
+}
+
+static void read_frame(Bench *b) {
+    b->bus.read_frame(&b->frame);
+}
+
+static void read_frames(Bench *b) {
+    CanFrame frames[2];
+    b->bus.read_frames(frames, 2);
+}
+
+static const Case s_cases[] = {
+    {"begin", nullptr, begin, false},
+    {"set_filter", nullptr, set_filter, false},
+    {"set_mask", nullptr, set_mask, false},
+    {"send_buffer", nullptr, send_buffer, false},
+    {"try_send", nullptr, try_send, false},
+    {"queue_send", nullptr, queue_send, true},
+    {"read_buffer", inject, read_buffer, false},
+    {"read_frame", inject, read_frame, false},
+    {"read_frames_x2", inject_pair, read_frames, false},
+};
+
+static uint64_t now_ns(void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t timer_overhead(uint32_t iterations) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t start = now_ns();
+        total += now_ns() - start;
+    }
+    return total;
+}
+
+static void measure(const Case &c, uint32_t iterations, double spiClock, uint64_t overhead) {
+    Bench *b = new Bench();
+    b->bus.begin(CAN_500KBPS, MCP_8MHz);
+    if (c.queued) {
+        b->bus.set_transmit_queue(b->entries, 4, nullptr, nullptr);
+    }
+    b->counter.clear();
+
+    uint64_t elapsed = 0;
+    for (b->n = 0; b->n < iterations; ++b->n) {
+        if (c.setup) {
+            c.setup(b);
+        }
+        uint64_t start = now_ns();
+        c.run(b);
+        elapsed += now_ns() - start;
+    }
+    elapsed = elapsed > overhead ? elapsed - overhead : 0;
+
+    const sim::Counts &counts = b->counter.counts();
+    double bytes = (double) counts.bytes / iterations;
+    double limit = bytes > 0 ? spiClock / (8.0 * bytes) : 0.0;
+    printf("%s,%u,%.2f,%.2f,%.2f,%.2f,%.1f,%.0f\n",
+           c.name, iterations,
+           (double) counts.calls / iterations,
+           (double) counts.transactions / iterations,
+           (double) counts.acquires / iterations,
+           bytes,
+           (double) elapsed / iterations,
+           limit);
+    delete b;
+}
+
+int main(int argc, char *argv[]) {
+    double spiClock = argc > 1 ? atof(argv[1]) : 10000000.0;
+    uint32_t iterations = argc > 2 ? (uint32_t) atol(argv[2]) : 100000;
+    if (spiClock <= 0 || 0 == iterations) {
+        fprintf(stderr, "usage: %s [spi clock in Hz] [iterations]\n", argv[0]);
+        return 1;
+    }
+    uint64_t overhead = timer_overhead(iterations);
+    printf("case,iterations,calls,transactions,acquires,bytes,ns,spi_limit\n");
+    for (const Case &c : s_cases) {
+        measure(c, iterations, spiClock, overhead);
+    }
+    return 0;
+}
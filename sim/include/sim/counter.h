@@ -0,0 +1,61 @@
+#ifndef __SIM_COUNTER_H__
+#define __SIM_COUNTER_H__
+
+#include <MCP2515Base.h>
+
+namespace wlp {
+    namespace sim {
+
+        struct Counts {
+            // MCP2515Base entry points called by the driver
+            uint32_t calls;
+            // Chip-select cycles, one per SPI instruction
+            uint32_t transactions;
+            // Bytes clocked over the bus, instruction and address included
+            uint32_t bytes;
+            // Times the bus is taken, once per outermost session and once
+            // per call made outside a session
+            uint32_t acquires;
+        };
+
+        /**
+         * MCP2515Base decorator that forwards to another backend and counts
+         * what the same calls would cost on a real SPI bus.
+         */
+        class Counter : public wlp::MCP2515Base {
+        public:
+            explicit Counter(MCP2515Base *base);
+
+            void reset(void) override;
+            uint8_t read_status(void) override;
+            uint8_t read_register(uint8_t address) override;
+            void read_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+            void set_register(uint8_t address, uint8_t value) override;
+            void set_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+            void modify_register(uint8_t address, uint8_t mask, uint8_t data) override;
+            void read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void request_to_send(uint8_t instruction) override;
+            void execute(CommandList &list) override;
+            uint64_t now(void) override;
+            uint64_t receive_time(uint8_t rxBuf) override;
+            void begin_session(void) override;
+            void end_session(void) override;
+
+            const Counts &counts(void) const;
+            void clear(void);
+
+        private:
+            void count(uint16_t bytes);
+
+            void acquire(void);
+
+            MCP2515Base *m_base;
+            Counts m_counts;
+            uint8_t m_depth;
+        };
+
+    }
+}
+
+#endif
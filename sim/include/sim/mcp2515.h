@@ -0,0 +1,103 @@
+#ifndef __SIM_MCP2515_H__
+#define __SIM_MCP2515_H__
+
+#include <MCP2515Base.h>
+#include <MCP2515Const.h>
+#include <CanFrame.h>
+
+namespace wlp {
+    namespace sim {
+
+        namespace Delivery {
+            enum {
+                RX0 = 0x00,
+                RX1 = 0x01,
+                Filtered = 0x02,
+                Overflow = 0x03,
+                Offline = 0x04,
+            };
+        }
+
+        typedef void (*FrameHook)(void *context, const CanFrame *frame);
+
+        /**
+         * Register-level model of the MCP2515. The SPI side implements
+         * MCP2515Base; the bus side lets a test inject incoming frames,
+         * complete pending transmissions and provoke bus errors.
+         */
+        class MCP2515 final : public wlp::MCP2515Base {
+        public:
+            MCP2515();
+
+            void reset(void) override;
+            uint8_t read_status(void) override;
+            uint8_t read_register(uint8_t address) override;
+            void read_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+            void set_register(uint8_t address, uint8_t value) override;
+            void set_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+            void modify_register(uint8_t address, uint8_t mask, uint8_t data) override;
+            void read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void request_to_send(uint8_t instruction) override;
+            void execute(CommandList &list) override;
+            // The simulated clock when the frame in rxBuf was received
+            uint64_t receive_time(uint8_t rxBuf) override;
+            uint64_t now(void) override;
+
+            // Offer a frame from the bus, returns a Delivery code
+            uint8_t inject(const CanFrame *frame);
+            // Put the highest priority pending buffer on the bus, returns
+            // the number of frames sent (0 or 1)
+            uint8_t transmit(void);
+            // When enabled (default) a transmission completes as soon as
+            // TXREQ is set
+            void set_auto_transmit(bool enabled);
+            void set_transmit_hook(FrameHook hook, void *context);
+            // Time in ns reported to the driver as the receive time and
+            // by now(); at 0 the driver treats the clock as absent
+            void set_time(uint64_t ns);
+
+            // The next n transmission attempts fail with a bit error
+            void fail_transmissions(uint8_t n);
+            void receive_errors(uint8_t n);
+            // 128 occurrences of 11 recessive bits: leave bus-off
+            void bus_idle(void);
+
+            // State of the active-low INT pin, true when asserted
+            bool interrupt(void) const;
+            uint8_t mode(void) const;
+            // Backdoor access that bypasses write protection
+            uint8_t peek(uint8_t address) const;
+            void poke(uint8_t address, uint8_t value);
+
+        private:
+            enum {
+                RegisterCount = 0x80,
+            };
+
+            uint8_t read(uint8_t address);
+            void write(uint8_t address, uint8_t mask, uint8_t value);
+            void write_control(uint8_t value);
+            void request(uint8_t txBuf);
+            void abort(uint8_t txBuf);
+            void complete(uint8_t txBuf);
+            uint8_t deliver(const uint8_t raw[]);
+            bool accepts(uint8_t filter, uint8_t mask, const uint8_t raw[]) const;
+            void receive(uint8_t rxBuf, const uint8_t raw[], uint8_t filhit);
+            void update_errors(void);
+
+            uint8_t m_regs[RegisterCount];
+            uint16_t m_tec;
+            uint16_t m_rec;
+            uint8_t m_failures;
+            bool m_autoTransmit;
+            FrameHook m_hook;
+            void *m_context;
+            uint64_t m_time;
+            uint64_t m_rxTime[2];
+        };
+
+    }
+}
+
+#endif
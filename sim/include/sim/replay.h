@@ -0,0 +1,97 @@
+#ifndef __SIM_REPLAY_H__
+#define __SIM_REPLAY_H__
+
+#include <sim/mcp2515.h>
+#include <sys/mcp2515_capture.h>
+
+namespace wlp {
+    namespace sim {
+
+        namespace ReplayTiming {
+            enum {
+                // Gaps between records as captured
+                Original = 0x00,
+                // Gaps divided by the scale factor
+                Scaled = 0x01,
+                // Next record as soon as a receive buffer is free
+                MaxSpeed = 0x02,
+            };
+        }
+
+        struct ReplayStats {
+            // records offered to the chip
+            uint32_t offered;
+            // frames read out of the receive buffers by the driver
+            uint32_t received;
+            // records that arrived with both receive buffers full
+            uint32_t lost;
+            // records rejected by the acceptance filters
+            uint32_t filtered;
+            // ns from the first record offered to the last frame read
+            uint64_t elapsed;
+        };
+
+        /**
+         * MCP2515Base that plays a capture into the register simulator.
+         * Records due by the replay clock are injected on the bus side of
+         * `chip` whenever the driver polls the status or reads registers,
+         * so they come out through the normal RXnIF flags and READ RX
+         * BUFFER path. receive_time() reports the captured timestamp of
+         * each frame.
+         *
+         * The records must stay valid while the replay runs; a
+         * CaptureReader's begin() and end() can be passed directly.
+         */
+        class Replay final : public wlp::MCP2515Base {
+        public:
+            explicit Replay(MCP2515 *chip);
+
+            void load(const linux::CaptureRecord *begin, const linux::CaptureRecord *end);
+            // scale only applies to ReplayTiming::Scaled, 2.0 plays twice
+            // as fast as captured
+            void set_timing(uint8_t timing, double scale = 1.0);
+
+            // Offer every record that is due, returns how many were offered
+            uint32_t pump(void);
+            // All records offered and read back out
+            bool done(void) const;
+
+            const ReplayStats &stats(void) const;
+            // Frames per second read by the driver
+            double throughput(void) const;
+
+            void reset(void) override;
+            uint8_t read_status(void) override;
+            uint8_t read_register(uint8_t address) override;
+            void read_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+            void set_register(uint8_t address, uint8_t value) override;
+            void set_registers(uint8_t address, uint8_t values[], uint8_t n) override;
+            void modify_register(uint8_t address, uint8_t mask, uint8_t data) override;
+            void read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) override;
+            void request_to_send(uint8_t instruction) override;
+            void execute(CommandList &list) override;
+            uint64_t receive_time(uint8_t rxBuf) override;
+            uint64_t now(void) override;
+            void begin_session(void) override;
+            void end_session(void) override;
+
+        private:
+            bool due(const linux::CaptureRecord *record, uint64_t now) const;
+            bool has_room(void) const;
+            void offer(const linux::CaptureRecord *record);
+
+            MCP2515 *m_chip;
+            const linux::CaptureRecord *m_next;
+            const linux::CaptureRecord *m_end;
+            uint64_t m_first;
+            uint64_t m_start;
+            uint8_t m_timing;
+            double m_scale;
+            ReplayStats m_stats;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include <sim/mcp2515.h>
+#include <sim/replay.h>
+#include <MCP2515.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace wlp;
+
+/*
+ * Plays a capture through the driver and reports what the consumer
+ * achieved:
+ *
+ *   frames,received,lost,filtered,seconds,frames_per_second
+ *
+ * usage: sim_replay <capture> [original|max|scale factor]
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <capture> [original|max|scale factor]\n", argv[0]);
+        return 1;
+    }
+    linux::CaptureReader reader;
+    if (reader.open(argv[1]) != 0) {
+        fprintf(stderr, "%s: cannot read capture\n", argv[1]);
+        return 1;
+    }
+
+    static sim::MCP2515 chip;
+    static sim::Replay replay(&chip);
+    BasicMCP2515<sim::Replay> bus(&replay);
+    bus.begin(CAN_500KBPS, MCP_8MHz);
+    replay.load(reader.begin(), reader.end());
+    const char *timing = argc > 2 ? argv[2] : "max";
+    if (0 == strcmp(timing, "original")) {
+        replay.set_timing(sim::ReplayTiming::Original);
+    } else if (0 == strcmp(timing, "max")) {
+        replay.set_timing(sim::ReplayTiming::MaxSpeed);
+    } else {
+        replay.set_timing(sim::ReplayTiming::Scaled, atof(timing));
+    }
+
+    CanFrame frames[2];
+    FrameInfo info[2];
+    while (!replay.done()) {
+        bus.read_frames(frames, 2, info);
+    }
+
+    const sim::ReplayStats &stats = replay.stats();
+    printf("frames,received,lost,filtered,seconds,frames_per_second\n");
+    printf("%llu,%u,%u,%u,%.3f,%.0f\n",
+           (unsigned long long) reader.size(),
+           stats.received, stats.lost, stats.filtered,
+           stats.elapsed / 1e9, replay.throughput());
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <sim/counter.h>
+
+using namespace wlp;
+
+sim::Counter::Counter(MCP2515Base *base) :
+    m_base(base),
+    m_depth(0) {
+    clear();
+}
+
+void sim::Counter::reset(void) {
+    count(1);
+    m_base->reset();
+}
+
+uint8_t sim::Counter::read_status(void) {
+    count(2);
+    return m_base->read_status();
+}
+
+uint8_t sim::Counter::read_register(uint8_t address) {
+    count(3);
+    return m_base->read_register(address);
+}
+
+void sim::Counter::read_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    count(2 + n);
+    m_base->read_registers(address, values, n);
+}
+
+void sim::Counter::set_register(uint8_t address, uint8_t value) {
+    count(3);
+    m_base->set_register(address, value);
+}
+
+void sim::Counter::set_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    count(2 + n);
+    m_base->set_registers(address, values, n);
+}
+
+void sim::Counter::modify_register(uint8_t address, uint8_t mask, uint8_t data) {
+    count(4);
+    m_base->modify_register(address, mask, data);
+}
+
+void sim::Counter::read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    count(1 + n);
+    m_base->read_rx_buffer(instruction, values, n);
+}
+
+void sim::Counter::load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    count(1 + n);
+    m_base->load_tx_buffer(instruction, values, n);
+}
+
+void sim::Counter::request_to_send(uint8_t instruction) {
+    count(1);
+    m_base->request_to_send(instruction);
+}
+
+void sim::Counter::execute(CommandList &list) {
+    ++m_counts.calls;
+    acquire();
+    for (uint8_t i = 0; i < list.size(); ++i) {
+        ++m_counts.transactions;
+        m_counts.bytes += list[i].headerLength + list[i].length;
+    }
+    m_base->execute(list);
+}
+
+uint64_t sim::Counter::now(void) {
+    // Reading the clock costs no bus traffic
+    return m_base->now();
+}
+
+uint64_t sim::Counter::receive_time(uint8_t rxBuf) {
+    return m_base->receive_time(rxBuf);
+}
+
+void sim::Counter::begin_session(void) {
+    acquire();
+    ++m_depth;
+    m_base->begin_session();
+}
+
+void sim::Counter::end_session(void) {
+    --m_depth;
+    m_base->end_session();
+}
+
+const sim::Counts &sim::Counter::counts(void) const {
+    return m_counts;
+}
+
+void sim::Counter::clear(void) {
+    m_counts.calls = 0;
+    m_counts.transactions = 0;
+    m_counts.bytes = 0;
+    m_counts.acquires = 0;
+}
+
+void sim::Counter::acquire(void) {
+    if (0 == m_depth) {
+        ++m_counts.acquires;
+    }
+}
+
+void sim::Counter::count(uint16_t bytes) {
+    ++m_counts.calls;
+    acquire();
+    ++m_counts.transactions;
+    m_counts.bytes += bytes;
+}
@@ -0,0 +1,162 @@
+#include <sim/replay.h>
+#include <sys/mcp2515_interrupt.h>
+
+using namespace wlp;
+
+sim::Replay::Replay(MCP2515 *chip) :
+    m_chip(chip),
+    m_next(nullptr),
+    m_end(nullptr),
+    m_first(0),
+    m_start(0),
+    m_timing(ReplayTiming::Original),
+    m_scale(1.0),
+    m_stats() {}
+
+void sim::Replay::load(const linux::CaptureRecord *begin, const linux::CaptureRecord *end) {
+    m_next = begin;
+    m_end = end;
+    m_first = begin != end ? begin->timestamp : 0;
+    m_start = 0;
+    m_stats = ReplayStats();
+}
+
+void sim::Replay::set_timing(uint8_t timing, double scale) {
+    m_timing = timing;
+    m_scale = scale > 0 ? scale : 1.0;
+}
+
+uint32_t sim::Replay::pump(void) {
+    if (m_next == m_end) {
+        return 0;
+    }
+    // Hold the replay clock until the driver has the chip on the bus
+    uint8_t mode = m_chip->mode();
+    if (Mode::Normal != mode && Mode::ListenOnly != mode) {
+        return 0;
+    }
+    uint64_t now = linux::monotonic_ns();
+    if (0 == m_start) {
+        m_start = now;
+    }
+    uint32_t n = 0;
+    while (m_next != m_end && due(m_next, now)) {
+        offer(m_next++);
+        ++n;
+    }
+    return n;
+}
+
+bool sim::Replay::done(void) const {
+    return m_next == m_end &&
+           m_stats.offered == m_stats.received + m_stats.lost + m_stats.filtered;
+}
+
+const sim::ReplayStats &sim::Replay::stats(void) const {
+    return m_stats;
+}
+
+double sim::Replay::throughput(void) const {
+    if (0 == m_stats.elapsed) {
+        return 0.0;
+    }
+    return m_stats.received * 1e9 / m_stats.elapsed;
+}
+
+bool sim::Replay::due(const linux::CaptureRecord *record, uint64_t now) const {
+    uint64_t offset = record->timestamp - m_first;
+    if (ReplayTiming::MaxSpeed == m_timing) {
+        return has_room();
+    }
+    if (ReplayTiming::Scaled == m_timing) {
+        offset = (uint64_t) (offset / m_scale);
+    }
+    return offset <= now - m_start;
+}
+
+bool sim::Replay::has_room(void) const {
+    uint8_t flags = m_chip->peek(Register::InterruptFlag);
+    if (!(flags & InterruptFlag::RX0)) {
+        return true;
+    }
+    bool rollover = 0 != (m_chip->peek(Register::RXB0CTRL) & RXControlMask::AcceptBUKT);
+    return rollover && !(flags & InterruptFlag::RX1);
+}
+
+void sim::Replay::offer(const linux::CaptureRecord *record) {
+    CanFrame frame;
+    linux::capture_frame(record, &frame);
+    m_chip->set_time(record->timestamp);
+    uint8_t delivery = m_chip->inject(&frame);
+    ++m_stats.offered;
+    if (Delivery::Overflow == delivery) {
+        ++m_stats.lost;
+    } else if (Delivery::Filtered == delivery) {
+        ++m_stats.filtered;
+    }
+}
+
+void sim::Replay::reset(void) {
+    m_chip->reset();
+}
+
+uint8_t sim::Replay::read_status(void) {
+    pump();
+    return m_chip->read_status();
+}
+
+uint8_t sim::Replay::read_register(uint8_t address) {
+    pump();
+    return m_chip->read_register(address);
+}
+
+void sim::Replay::read_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    pump();
+    m_chip->read_registers(address, values, n);
+}
+
+void sim::Replay::set_register(uint8_t address, uint8_t value) {
+    m_chip->set_register(address, value);
+}
+
+void sim::Replay::set_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    m_chip->set_registers(address, values, n);
+}
+
+void sim::Replay::modify_register(uint8_t address, uint8_t mask, uint8_t data) {
+    m_chip->modify_register(address, mask, data);
+}
+
+void sim::Replay::read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    m_chip->read_rx_buffer(instruction, values, n);
+    ++m_stats.received;
+    m_stats.elapsed = linux::monotonic_ns() - m_start;
+}
+
+void sim::Replay::load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    m_chip->load_tx_buffer(instruction, values, n);
+}
+
+void sim::Replay::request_to_send(uint8_t instruction) {
+    m_chip->request_to_send(instruction);
+}
+
+void sim::Replay::execute(CommandList &list) {
+    run_commands(*this, list);
+}
+
+uint64_t sim::Replay::receive_time(uint8_t rxBuf) {
+    return m_chip->receive_time(rxBuf);
+}
+
+uint64_t sim::Replay::now(void) {
+    return m_chip->now();
+}
+
+void sim::Replay::begin_session(void) {
+    m_chip->begin_session();
+}
+
+void sim::Replay::end_session(void) {
+    m_chip->end_session();
+}
@@ -0,0 +1,593 @@
+#include <sim/mcp2515.h>
+
+using namespace wlp;
+
+namespace {
+    enum {
+        CANSTAT = 0x0E,
+        CANCTRL = 0x0F,
+        TEC = 0x1C,
+        REC = 0x1D,
+
+        OneShot = 0x08,
+        AbortAll = 0x10,
+
+        RXRemote = 0x08,
+        RXFilterHit = 0x07,
+        RXRollover = 0x02,
+    };
+}
+
+static uint8_t tx_ctrl(uint8_t txBuf) {
+    return Register::TXB0CTRL + txBuf * Limit::TXBufferLength;
+}
+
+static uint8_t rx_ctrl(uint8_t rxBuf) {
+    return Register::RXB0CTRL + rxBuf * Limit::TXBufferLength;
+}
+
+static bool is_filter(uint8_t address) {
+    return address < Register::RXM0SIDH &&
+           (address & 0x0F) < 0x0C;
+}
+
+static uint8_t writable(uint8_t address, bool config) {
+    uint8_t low = address & 0x0F;
+    if (CANSTAT == low) {
+        return 0x00;
+    }
+    if (is_filter(address)) {
+        if (!config) {
+            return 0x00;
+        }
+        return (Bits::SIDL == (low & 0x03)) ? 0xEB : 0xFF;
+    }
+    if (address >= Register::RXM0SIDH && address <= Register::RXM1EIDL) {
+        if (!config) {
+            return 0x00;
+        }
+        return (Bits::SIDL == (address & 0x03)) ? 0xE3 : 0xFF;
+    }
+    switch (address) {
+        case 0x0C: return 0x3F;
+        case 0x0D: return config ? 0x38 : 0x00;
+        case Register::RateConfig3: return config ? 0xC7 : 0x00;
+        case Register::RateConfig2: return config ? 0xFF : 0x00;
+        case Register::RateConfig1: return config ? 0xFF : 0x00;
+        case Register::InterruptEnable: return 0xFF;
+        case Register::InterruptFlag: return 0xFF;
+        case Register::ErrorFlag: return ErrorMask::RXOverflow;
+        case Register::TXB0CTRL:
+        case Register::TXB1CTRL:
+        case Register::TXB2CTRL:
+            return TXControlMask::RequestInProcess | TXControlMask::Priority;
+        case Register::RXB0CTRL: return RXControlMask::AcceptAny | RXControlMask::AcceptBUKT;
+        case Register::RXB1CTRL: return RXControlMask::AcceptAny;
+    }
+    if (address > Register::TXB0CTRL && address < Register::RXB0CTRL) {
+        uint8_t offset = low - 1;
+        if (offset >= Limit::FrameLength) {
+            return 0x00;
+        }
+        if (Bits::SIDL == offset) {
+            return 0xEB;
+        }
+        if (Bits::DLC == offset) {
+            return Mask::RemoteRequest | Mask::DLC;
+        }
+        return 0xFF;
+    }
+    return 0x00;
+}
+
+static bool bit_modifiable(uint8_t address) {
+    switch (address) {
+        case 0x0C:
+        case 0x0D:
+        case Register::RateConfig3:
+        case Register::RateConfig2:
+        case Register::RateConfig1:
+        case Register::InterruptEnable:
+        case Register::InterruptFlag:
+        case Register::ErrorFlag:
+        case Register::TXB0CTRL:
+        case Register::TXB1CTRL:
+        case Register::TXB2CTRL:
+        case Register::RXB0CTRL:
+        case Register::RXB1CTRL:
+            return true;
+    }
+    return CANCTRL == (address & 0x0F);
+}
+
+// Bus representation of a frame as it appears in a receive buffer
+static void to_raw(uint8_t raw[], const CanFrame *frame) {
+    for (uint8_t i = 0; i < Limit::FrameLength; ++i) {
+        raw[i] = 0;
+    }
+    bool remote = frame->flags & FrameFlag::RemoteRequest;
+    if (frame->flags & FrameFlag::Extended) {
+        uint32_t sid = (frame->id >> 18) & 0x7FF;
+        raw[Bits::SIDH] = sid >> 3;
+        raw[Bits::SIDL] = ((sid & 0x07) << 5) | Mask::ExtendedID | ((frame->id >> 16) & 0x03);
+        raw[Bits::EIDH] = (frame->id >> 8) & 0xFF;
+        raw[Bits::EIDL] = frame->id & 0xFF;
+        raw[Bits::DLC] = remote ? Mask::RemoteRequest : 0;
+    } else {
+        uint32_t sid = frame->id & 0x7FF;
+        raw[Bits::SIDH] = sid >> 3;
+        raw[Bits::SIDL] = (sid & 0x07) << 5;
+        if (remote) {
+            raw[Bits::SIDL] |= Mask::StandardRemoteRequest;
+        }
+    }
+    uint8_t dlc = frame->dlc & Mask::DLC;
+    raw[Bits::DLC] |= dlc;
+    if (dlc > Limit::MessageBufferLength) {
+        dlc = Limit::MessageBufferLength;
+    }
+    for (uint8_t i = 0; i < dlc && !remote; ++i) {
+        raw[Bits::D0 + i] = frame->data[i];
+    }
+}
+
+// Frame as loaded into a transmit buffer
+static void to_frame(CanFrame *frame, const uint8_t raw[]) {
+    uint32_t sid = (raw[Bits::SIDH] << 3) | (raw[Bits::SIDL] >> 5);
+    frame->flags = 0;
+    if (raw[Bits::SIDL] & Mask::ExtendedID) {
+        frame->flags |= FrameFlag::Extended;
+        frame->id = (sid << 18) |
+                    ((uint32_t) (raw[Bits::SIDL] & 0x03) << 16) |
+                    ((uint32_t) raw[Bits::EIDH] << 8) |
+                    raw[Bits::EIDL];
+    } else {
+        frame->id = sid;
+    }
+    if (raw[Bits::DLC] & Mask::RemoteRequest) {
+        frame->flags |= FrameFlag::RemoteRequest;
+    }
+    frame->dlc = raw[Bits::DLC] & Mask::DLC;
+    for (uint8_t i = 0; i < Limit::MessageBufferLength; ++i) {
+        frame->data[i] = (i < frame->dlc) ? raw[Bits::D0 + i] : 0;
+    }
+}
+
+sim::MCP2515::MCP2515() :
+    m_tec(0),
+    m_rec(0),
+    m_failures(0),
+    m_autoTransmit(true),
+    m_hook(nullptr),
+    m_context(nullptr),
+    m_time(0),
+    m_rxTime() {
+    reset();
+}
+
+void sim::MCP2515::reset(void) {
+    for (uint8_t i = 0; i < RegisterCount; ++i) {
+        m_regs[i] = 0;
+    }
+    m_regs[CANCTRL] = 0x87;
+    m_regs[CANSTAT] = Mode::Config;
+    m_tec = 0;
+    m_rec = 0;
+}
+
+uint8_t sim::MCP2515::read_status(void) {
+    uint8_t flags = m_regs[Register::InterruptFlag];
+    uint8_t status = flags & (InterruptFlag::RX0 | InterruptFlag::RX1);
+    for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+        if (m_regs[tx_ctrl(i)] & TXControlMask::RequestInProcess) {
+            status |= Status::TX0Pending << (2 * i);
+        }
+        if (flags & (InterruptFlag::TX0 << i)) {
+            status |= Status::TX0InterruptFired << (2 * i);
+        }
+    }
+    return status;
+}
+
+uint8_t sim::MCP2515::read_register(uint8_t address) {
+    return read(address);
+}
+
+void sim::MCP2515::read_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    for (uint8_t i = 0; i < n; ++i) {
+        values[i] = read(address + i);
+    }
+}
+
+void sim::MCP2515::set_register(uint8_t address, uint8_t value) {
+    write(address, 0xFF, value);
+}
+
+void sim::MCP2515::set_registers(uint8_t address, uint8_t values[], uint8_t n) {
+    for (uint8_t i = 0; i < n; ++i) {
+        write(address + i, 0xFF, values[i]);
+    }
+}
+
+void sim::MCP2515::modify_register(uint8_t address, uint8_t mask, uint8_t data) {
+    // BIT MODIFY on other registers behaves as a write with mask 0xFF
+    write(address, bit_modifiable(address) ? mask : 0xFF, data);
+}
+
+void sim::MCP2515::read_rx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    uint8_t rxBuf = (instruction >> 2) & 0x01;
+    uint8_t address = Register::RXB0SIDH + rxBuf * Limit::TXBufferLength;
+    if (instruction & 0x02) {
+        address += Bits::D0;
+    }
+    read_registers(address, values, n);
+    m_regs[Register::InterruptFlag] &= ~(InterruptFlag::RX0 << rxBuf);
+}
+
+void sim::MCP2515::load_tx_buffer(uint8_t instruction, uint8_t values[], uint8_t n) {
+    uint8_t txBuf = (instruction >> 1) & 0x03;
+    uint8_t address = Register::TXB0SIDH + txBuf * Limit::TXBufferLength;
+    if (instruction & 0x01) {
+        address += Bits::D0;
+    }
+    set_registers(address, values, n);
+}
+
+void sim::MCP2515::request_to_send(uint8_t instruction) {
+    for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+        if (instruction & (1 << i)) {
+            write(tx_ctrl(i), TXControlMask::RequestInProcess, TXControlMask::RequestInProcess);
+        }
+    }
+}
+
+void sim::MCP2515::execute(CommandList &list) {
+    run_commands(*this, list);
+}
+
+uint64_t sim::MCP2515::receive_time(uint8_t rxBuf) {
+    return m_rxTime[rxBuf & 1];
+}
+
+uint64_t sim::MCP2515::now(void) {
+    return m_time;
+}
+
+uint8_t sim::MCP2515::inject(const CanFrame *frame) {
+    uint8_t current = mode();
+    if (Mode::Normal != current && Mode::ListenOnly != current) {
+        return Delivery::Offline;
+    }
+    uint8_t raw[Limit::FrameLength];
+    to_raw(raw, frame);
+    return deliver(raw);
+}
+
+uint8_t sim::MCP2515::deliver(const uint8_t raw[]) {
+    bool extended = raw[Bits::SIDL] & Mask::ExtendedID;
+    uint8_t flags = m_regs[Register::InterruptFlag];
+    for (uint8_t rxBuf = 0; rxBuf < 2; ++rxBuf) {
+        uint8_t rxm = m_regs[rx_ctrl(rxBuf)] & RXControlMask::AcceptAny;
+        uint8_t first = rxBuf ? 2 : 0;
+        uint8_t last = rxBuf ? 6 : 2;
+        int8_t hit = -1;
+        if (RXControlMask::AcceptAny == rxm) {
+            hit = first;
+        } else if (
+                !(RXControlMask::AcceptOnlyStandardID == rxm && extended) &&
+                !(RXControlMask::AcceptOnlyExtendedID == rxm && !extended)) {
+            for (uint8_t f = first; f < last && hit < 0; ++f) {
+                if (accepts(f, rxBuf, raw)) {
+                    hit = f;
+                }
+            }
+        }
+        if (hit < 0) {
+            continue;
+        }
+        if (!(flags & (InterruptFlag::RX0 << rxBuf))) {
+            receive(rxBuf, raw, hit);
+            return rxBuf;
+        }
+        if (0 == rxBuf && (m_regs[Register::RXB0CTRL] & RXControlMask::AcceptBUKT)) {
+            if (!(flags & InterruptFlag::RX1)) {
+                receive(1, raw, hit);
+                return Delivery::RX1;
+            }
+            rxBuf = 1;
+        }
+        m_regs[Register::ErrorFlag] |= rxBuf ? ErrorFlag::RX1Overflow : ErrorFlag::RX0Overflow;
+        m_regs[Register::InterruptFlag] |= InterruptFlag::Error;
+        return Delivery::Overflow;
+    }
+    return Delivery::Filtered;
+}
+
+uint8_t sim::MCP2515::transmit(void) {
+    uint8_t current = mode();
+    if (Mode::Normal != current && Mode::Loopback != current) {
+        return 0;
+    }
+    if (m_regs[Register::ErrorFlag] & ErrorFlag::BusOff) {
+        return 0;
+    }
+    int8_t best = -1;
+    uint8_t bestPriority = 0;
+    for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+        uint8_t ctrl = m_regs[tx_ctrl(i)];
+        if (!(ctrl & TXControlMask::RequestInProcess)) {
+            continue;
+        }
+        // equal priorities go out highest buffer number first
+        uint8_t priority = ctrl & TXControlMask::Priority;
+        if (best < 0 || priority >= bestPriority) {
+            best = i;
+            bestPriority = priority;
+        }
+    }
+    if (best < 0) {
+        return 0;
+    }
+    if (m_failures > 0 && Mode::Loopback != current) {
+        --m_failures;
+        m_regs[tx_ctrl(best)] |= TXControlMask::Error;
+        m_tec += 8;
+        update_errors();
+        if ((m_regs[CANCTRL] & OneShot) || (m_regs[Register::ErrorFlag] & ErrorFlag::BusOff)) {
+            abort(best);
+        }
+        return 0;
+    }
+    complete(best);
+    return 1;
+}
+
+void sim::MCP2515::set_auto_transmit(bool enabled) {
+    m_autoTransmit = enabled;
+    while (m_autoTransmit && transmit());
+}
+
+void sim::MCP2515::set_transmit_hook(FrameHook hook, void *context) {
+    m_hook = hook;
+    m_context = context;
+}
+
+void sim::MCP2515::set_time(uint64_t ns) {
+    m_time = ns;
+}
+
+void sim::MCP2515::fail_transmissions(uint8_t n) {
+    m_failures = n;
+}
+
+void sim::MCP2515::receive_errors(uint8_t n) {
+    m_rec += n;
+    if (m_rec > 255) {
+        m_rec = 255;
+    }
+    update_errors();
+}
+
+void sim::MCP2515::bus_idle(void) {
+    if (m_regs[Register::ErrorFlag] & ErrorFlag::BusOff) {
+        m_tec = 0;
+        m_rec = 0;
+        update_errors();
+    }
+}
+
+bool sim::MCP2515::interrupt(void) const {
+    return 0 != (m_regs[Register::InterruptEnable] & m_regs[Register::InterruptFlag]);
+}
+
+uint8_t sim::MCP2515::mode(void) const {
+    return m_regs[CANSTAT] & ControlMask::Mode;
+}
+
+uint8_t sim::MCP2515::peek(uint8_t address) const {
+    return (address < RegisterCount) ? m_regs[address] : 0;
+}
+
+void sim::MCP2515::poke(uint8_t address, uint8_t value) {
+    if (address < RegisterCount) {
+        m_regs[address] = value;
+    }
+}
+
+uint8_t sim::MCP2515::read(uint8_t address) {
+    if (address >= RegisterCount) {
+        return 0;
+    }
+    uint8_t low = address & 0x0F;
+    if (CANSTAT == low) {
+        // OPMOD plus ICOD for the highest priority pending interrupt
+        static const uint8_t order[] = {
+            InterruptFlag::Error, InterruptFlag::Wakeup,
+            InterruptFlag::TX0, InterruptFlag::TX1, InterruptFlag::TX2,
+            InterruptFlag::RX0, InterruptFlag::RX1,
+        };
+        uint8_t pending = m_regs[Register::InterruptEnable] & m_regs[Register::InterruptFlag];
+        uint8_t icod = 0;
+        for (uint8_t i = 0; i < sizeof(order) && 0 == icod; ++i) {
+            if (pending & order[i]) {
+                icod = i + 1;
+            }
+        }
+        return mode() | (icod << 1);
+    }
+    if (CANCTRL == low) {
+        return m_regs[CANCTRL];
+    }
+    if (TEC == address) {
+        return m_tec > 255 ? 255 : m_tec;
+    }
+    if (REC == address) {
+        return m_rec;
+    }
+    return m_regs[address];
+}
+
+void sim::MCP2515::write(uint8_t address, uint8_t mask, uint8_t value) {
+    if (address >= RegisterCount) {
+        return;
+    }
+    if (CANCTRL == (address & 0x0F)) {
+        write_control((m_regs[CANCTRL] & ~mask) | (value & mask));
+        return;
+    }
+    if (address > Register::TXB0CTRL && address < Register::RXB0CTRL) {
+        // buffer contents are locked while a transmission is pending
+        uint8_t ctrl = m_regs[address & 0xF0];
+        if ((address & 0x0F) && (ctrl & TXControlMask::RequestInProcess)) {
+            return;
+        }
+    }
+    uint8_t bits = writable(address, Mode::Config == mode()) & mask;
+    uint8_t old = m_regs[address];
+    m_regs[address] = (old & ~bits) | (value & bits);
+
+    if (Register::TXB0CTRL == address ||
+        Register::TXB1CTRL == address ||
+        Register::TXB2CTRL == address) {
+        uint8_t txBuf = (address - Register::TXB0CTRL) / Limit::TXBufferLength;
+        bool before = old & TXControlMask::RequestInProcess;
+        bool after = m_regs[address] & TXControlMask::RequestInProcess;
+        if (!before && after) {
+            request(txBuf);
+        } else if (before && !after) {
+            abort(txBuf);
+        }
+    }
+}
+
+void sim::MCP2515::write_control(uint8_t value) {
+    m_regs[CANCTRL] = value;
+    uint8_t requested = value & ControlMask::Mode;
+    if (requested <= Mode::Config) {
+        m_regs[CANSTAT] = requested;
+    }
+    if (value & AbortAll) {
+        for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+            if (m_regs[tx_ctrl(i)] & TXControlMask::RequestInProcess) {
+                abort(i);
+            }
+        }
+    }
+    while (m_autoTransmit && transmit());
+}
+
+void sim::MCP2515::request(uint8_t txBuf) {
+    m_regs[tx_ctrl(txBuf)] &= ~(
+        TXControlMask::Aborted |
+        TXControlMask::LostArbitration |
+        TXControlMask::Error);
+    if (m_regs[CANCTRL] & AbortAll) {
+        abort(txBuf);
+        return;
+    }
+    while (m_autoTransmit && transmit());
+}
+
+void sim::MCP2515::abort(uint8_t txBuf) {
+    m_regs[tx_ctrl(txBuf)] &= ~TXControlMask::RequestInProcess;
+    m_regs[tx_ctrl(txBuf)] |= TXControlMask::Aborted;
+}
+
+void sim::MCP2515::complete(uint8_t txBuf) {
+    uint8_t ctrl = tx_ctrl(txBuf);
+    m_regs[ctrl] &= ~(TXControlMask::RequestInProcess | TXControlMask::Error);
+    m_regs[Register::InterruptFlag] |= InterruptFlag::TX0 << txBuf;
+    if (m_tec > 0) {
+        --m_tec;
+        update_errors();
+    }
+    CanFrame frame;
+    to_frame(&frame, &m_regs[ctrl + 1]);
+    if (nullptr != m_hook) {
+        m_hook(m_context, &frame);
+    }
+    if (Mode::Loopback == mode()) {
+        uint8_t raw[Limit::FrameLength];
+        to_raw(raw, &frame);
+        deliver(raw);
+    }
+}
+
+bool sim::MCP2515::accepts(uint8_t filter, uint8_t mask, const uint8_t raw[]) const {
+    const uint8_t *f = &m_regs[(filter < 3) ? 4 * filter : Register::RXF3SIDH + 4 * (filter - 3)];
+    const uint8_t *m = &m_regs[Register::RXM0SIDH + 4 * mask];
+    bool extended = raw[Bits::SIDL] & Mask::ExtendedID;
+    if (extended != (0 != (f[Bits::SIDL] & Mask::ExtendedID))) {
+        return false;
+    }
+    if ((f[Bits::SIDH] ^ raw[Bits::SIDH]) & m[Bits::SIDH]) {
+        return false;
+    }
+    if ((f[Bits::SIDL] ^ raw[Bits::SIDL]) & m[Bits::SIDL] & 0xE0) {
+        return false;
+    }
+    if (extended) {
+        return !((f[Bits::SIDL] ^ raw[Bits::SIDL]) & m[Bits::SIDL] & 0x03) &&
+               !((f[Bits::EIDH] ^ raw[Bits::EIDH]) & m[Bits::EIDH]) &&
+               !((f[Bits::EIDL] ^ raw[Bits::EIDL]) & m[Bits::EIDL]);
+    }
+    // standard frames match the EID bits against the first two data bytes
+    return !((f[Bits::EIDH] ^ raw[Bits::D0]) & m[Bits::EIDH]) &&
+           !((f[Bits::EIDL] ^ raw[Bits::D0 + 1]) & m[Bits::EIDL]);
+}
+
+void sim::MCP2515::receive(uint8_t rxBuf, const uint8_t raw[], uint8_t filhit) {
+    uint8_t ctrl = rx_ctrl(rxBuf);
+    for (uint8_t i = 0; i < Limit::FrameLength; ++i) {
+        m_regs[ctrl + 1 + i] = raw[i];
+    }
+    m_rxTime[rxBuf] = m_time;
+    bool remote = (raw[Bits::SIDL] & Mask::ExtendedID)
+        ? (raw[Bits::DLC] & Mask::RemoteRequest)
+        : (raw[Bits::SIDL] & Mask::StandardRemoteRequest);
+    uint8_t value = m_regs[ctrl] & (RXControlMask::AcceptAny | RXControlMask::AcceptBUKT);
+    if (remote) {
+        value |= RXRemote;
+    }
+    if (0 == rxBuf) {
+        if (value & RXControlMask::AcceptBUKT) {
+            value |= RXRollover;
+        }
+        value |= filhit & 0x01;
+    } else {
+        value |= filhit & RXFilterHit;
+    }
+    m_regs[ctrl] = value;
+    m_regs[Register::InterruptFlag] |= InterruptFlag::RX0 << rxBuf;
+    if (m_rec > 0) {
+        --m_rec;
+        update_errors();
+    }
+}
+
+void sim::MCP2515::update_errors(void) {
+    uint8_t eflg = 0;
+    if (m_tec >= 96 || m_rec >= 96) {
+        eflg |= ErrorFlag::Warning;
+    }
+    if (m_rec >= 96) {
+        eflg |= ErrorFlag::RXWarning;
+    }
+    if (m_tec >= 96) {
+        eflg |= ErrorFlag::TXWarning;
+    }
+    if (m_rec >= 128) {
+        eflg |= ErrorFlag::RXPassive;
+    }
+    if (m_tec >= 128) {
+        eflg |= ErrorFlag::TXPassive;
+    }
+    if (m_tec >= 256) {
+        eflg |= ErrorFlag::BusOff;
+    }
+    uint8_t old = m_regs[Register::ErrorFlag];
+    if ((old & ~ErrorMask::RXOverflow) != eflg) {
+        m_regs[Register::ErrorFlag] = (old & ErrorMask::RXOverflow) | eflg;
+        m_regs[Register::InterruptFlag] |= InterruptFlag::Error;
+    }
+}
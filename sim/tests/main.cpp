@@ -0,0 +1,1002 @@
+#include <sim/mcp2515.h>
+#include <sim/counter.h>
+#include <sim/replay.h>
+#include <sys/mcp2515_reactor.h>
+#include <sys/mcp2515_receiver.h>
+#include <unistd.h>
+#include <MCP2515.h>
+#include <stdio.h>
+#include <assert.h>
+
+using namespace wlp;
+
+static CanFrame make_frame(uint32_t id, uint8_t flags, uint8_t dlc, uint8_t seed) {
+    CanFrame frame = {id, flags, dlc, {0}};
+    for (uint8_t i = 0; i < dlc; ++i) {
+        frame.data[i] = seed + i;
+    }
+    return frame;
+}
+
+static bool same_frame(const CanFrame &a, const CanFrame &b) {
+    if (a.id != b.id || a.flags != b.flags || a.dlc != b.dlc) {
+        return false;
+    }
+    for (uint8_t i = 0; i < a.dlc; ++i) {
+        if (a.data[i] != b.data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Sent {
+    CanFrame frames[16];
+    uint8_t count;
+};
+
+static void record(void *context, const CanFrame *frame) {
+    Sent *sent = static_cast<Sent *>(context);
+    sent->frames[sent->count++] = *frame;
+}
+
+static void start(sim::MCP2515 &base, MCP2515 &bus, bool rollover = false) {
+    assert(bus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    if (rollover) {
+        base.modify_register(
+            Register::RXB0CTRL,
+            RXControlMask::AcceptBUKT,
+            RXControlMask::AcceptBUKT);
+    }
+}
+
+static void test_begin() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus);
+    assert(base.mode() == Mode::Normal);
+    assert(base.peek(Register::InterruptEnable) == (InterruptFlag::RX0 | InterruptFlag::RX1));
+    // configuration is locked outside config mode
+    base.set_register(Register::RateConfig1, 0x3F);
+    assert(base.peek(Register::RateConfig1) != 0x3F);
+    printf("[OK] begin\n");
+}
+
+static void test_receive() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus);
+
+    CanFrame in = make_frame(0x123, 0, 8, 0x10);
+    CanFrame out;
+    assert(base.inject(&in) == sim::Delivery::RX0);
+    assert(base.interrupt());
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(same_frame(in, out));
+    assert(!base.interrupt());
+    assert(bus.read_frame(&out) == MessageState::NoMessage);
+
+    in = make_frame(0x1ABCDEF, FrameFlag::Extended, 3, 0x40);
+    base.inject(&in);
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(same_frame(in, out));
+
+    in = make_frame(0x7FF, FrameFlag::RemoteRequest, 0, 0);
+    base.inject(&in);
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(same_frame(in, out));
+
+    // legacy API
+    uint8_t buf[8];
+    in = make_frame(0x15, 0, 8, 0x80);
+    base.inject(&in);
+    assert(bus.get_message_status() == MessageState::MessagePending);
+    assert(bus.read_buffer(8, buf) == MessageState::MessageFetched);
+    assert(bus.get_id() == 0x15 && buf[7] == 0x87);
+    in = make_frame(0x12345, FrameFlag::Extended, 8, 0x40);
+    base.inject(&in);
+    buf[2] = 0;
+    assert(bus.read_buffer(2, buf) == MessageState::MessageFetched);
+    assert(bus.get_id() == 0x12345 && buf[1] == 0x41 && buf[2] == 0);
+    assert(bus.read_buffer(8, buf) == MessageState::NoMessage);
+    assert(bus.get_id() == 0x12345 && buf[2] == 0);
+    assert(bus.pending_interrupts() == 0);
+    base.inject(&in);
+    assert(bus.pending_interrupts() == InterruptFlag::RX0);
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(bus.pending_interrupts() == 0);
+    printf("[OK] receive\n");
+}
+
+static void test_rollover_and_overflow() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus, true);
+
+    CanFrame a = make_frame(0x100, 0, 1, 1);
+    CanFrame b = make_frame(0x101, 0, 1, 2);
+    CanFrame c = make_frame(0x102, 0, 1, 3);
+    assert(base.inject(&a) == sim::Delivery::RX0);
+    assert(base.inject(&b) == sim::Delivery::RX1);
+    assert(base.inject(&c) == sim::Delivery::Overflow);
+    assert(base.peek(Register::ErrorFlag) & ErrorFlag::RX1Overflow);
+    assert(bus.clear_overflow() == 1);
+
+    CanFrame out;
+    assert(bus.read_frame(&out) == MessageState::MessageFetched && out.id == 0x100);
+    assert(bus.read_frame(&out) == MessageState::MessageFetched && out.id == 0x101);
+    printf("[OK] rollover\n");
+}
+
+static void test_read_frames() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus, true);
+
+    CanFrame frames[4];
+    assert(bus.read_frames(frames, 4) == 0);
+
+    CanFrame a = make_frame(0x100, 0, 1, 1);
+    CanFrame b = make_frame(0x101, 0, 1, 2);
+    CanFrame c = make_frame(0x102, 0, 1, 3);
+    base.inject(&a);
+    base.inject(&b);
+    assert(bus.read_frames(frames, 4) == 2);
+    assert(same_frame(frames[0], a) && same_frame(frames[1], b));
+    assert(!base.interrupt());
+
+    // take only the RXB0 frame, the next arrival lands in RXB0 again and
+    // must come out after the one left in RXB1
+    base.inject(&a);
+    base.inject(&b);
+    assert(bus.read_frames(frames, 1) == 1 && frames[0].id == 0x100);
+    assert(base.inject(&c) == sim::Delivery::RX0);
+    assert(bus.read_frames(frames, 4) == 2);
+    assert(frames[0].id == 0x101 && frames[1].id == 0x102);
+    assert(bus.read_frames(frames, 4) == 0);
+    printf("[OK] read frames\n");
+}
+
+static void test_frame_info() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus, true);
+
+    CanFrame a = make_frame(0x100, 0, 1, 1);
+    CanFrame b = make_frame(0x123, 0, 1, 2);
+    CanFrame frames[2];
+    FrameInfo info[2];
+    base.set_time(1000);
+    base.inject(&a);
+    base.set_time(1500);
+    base.inject(&b);
+    assert(bus.read_frames(frames, 2, info) == 2);
+    assert(info[0].timestamp == 1000 && info[1].timestamp == 1500);
+    assert(info[0].sequence == 0 && info[1].sequence == 1);
+
+    // frames read without info still take a sequence number
+    base.inject(&a);
+    assert(bus.read_frame(&frames[0]) == MessageState::MessageFetched);
+
+    // the software filter moves info along with the kept frames and
+    // leaves a gap in the sequence for the dropped one
+    uint32_t slots[4];
+    SoftwareFilter filter(slots, 4);
+    filter.add(0x123, 0);
+    bus.set_software_filter(&filter);
+    base.set_time(2000);
+    base.inject(&a);
+    base.inject(&b);
+    assert(bus.read_frames(frames, 2, info) == 1 && frames[0].id == 0x123);
+    assert(info[0].timestamp == 2000 && info[0].sequence == 4);
+    printf("[OK] frame info\n");
+}
+
+static void test_filters() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus);
+    base.set_register(Register::Control, Mode::Config);
+    base.set_register(Register::RXB0CTRL, 0);
+    base.set_register(Register::RXB1CTRL, 0);
+    base.set_register(Register::Control, Mode::Normal);
+    bus.resync();
+    assert(bus.set_mask(0, 0x7FF) == Result::OK);
+    assert(bus.set_mask(1, 0x7FF) == Result::OK);
+    assert(bus.set_filter(0, 0x10) == Result::OK);
+    assert(bus.set_filter(2, 0x20) == Result::OK);
+    assert(bus.verify() == Result::OK);
+
+    CanFrame a = make_frame(0x10, 0, 0, 0);
+    CanFrame b = make_frame(0x20, 0, 0, 0);
+    CanFrame c = make_frame(0x30, 0, 0, 0);
+    assert(base.inject(&a) == sim::Delivery::RX0);
+    assert(base.inject(&b) == sim::Delivery::RX1);
+    assert(base.inject(&c) == sim::Delivery::Filtered);
+    assert((base.peek(Register::RXB1CTRL) & 0x07) == 2);
+    printf("[OK] filters\n");
+}
+
+static void test_acceptance() {
+    sim::MCP2515 base;
+    sim::Counter counter(&base);
+    MCP2515 bus(&counter);
+    assert(bus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    assert(bus.set_mode(Mode::ListenOnly) == Result::OK);
+
+    AcceptanceConfig config = {
+        {{0x7FF, 0}, {0x1FFFFFFF, FrameFlag::Extended}},
+        {{0x10, 0}, {0x11, 0},
+         {0x1ABCDEF, FrameFlag::Extended}, {0x1ABCDE0, FrameFlag::Extended},
+         {0, FrameFlag::Extended}, {0, FrameFlag::Extended}},
+        {RXControlMask::AcceptAnyID, RXControlMask::AcceptAnyID},
+    };
+    counter.clear();
+    assert(bus.configure_acceptance(&config) == Result::OK);
+    // one batch: enter config, three block writes, two RXBnCTRL, restore
+    assert(counter.counts().calls == 1);
+    assert(counter.counts().transactions == 9);
+    assert(base.mode() == Mode::ListenOnly);
+    assert(bus.verify() == Result::OK);
+
+    // unchanged blocks are skipped the second time
+    counter.clear();
+    assert(bus.configure_acceptance(&config) == Result::OK);
+    assert(counter.counts().transactions == 6);
+
+    CanFrame a = make_frame(0x11, 0, 0, 0);
+    CanFrame b = make_frame(0x1ABCDE0, FrameFlag::Extended, 0, 0);
+    CanFrame c = make_frame(0x12, 0, 0, 0);
+    CanFrame d = make_frame(0x11, FrameFlag::Extended, 0, 0);
+    assert(base.inject(&a) == sim::Delivery::RX0);
+    assert(base.inject(&b) == sim::Delivery::RX1);
+    CanFrame frames[2];
+    assert(bus.read_frames(frames, 2) == 2);
+    assert(base.inject(&c) == sim::Delivery::Filtered);
+    assert(base.inject(&d) == sim::Delivery::Filtered);
+
+    // set_filter and set_mask also leave the mode alone
+    assert(bus.set_mode(Mode::Loopback) == Result::OK);
+    assert(bus.set_filter(1, 0x12) == Result::OK);
+    assert(bus.set_mask(0, 0x7F0) == Result::OK);
+    assert(base.mode() == Mode::Loopback);
+    assert(bus.verify() == Result::OK);
+    printf("[OK] acceptance\n");
+}
+
+static void test_software_filter() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    start(base, bus, true);
+    uint32_t slots[8];
+    SoftwareFilter filter(slots, 8);
+    filter.add(0x123, 0);
+    filter.add(0x1ABCDEF, FrameFlag::Extended);
+    bus.set_software_filter(&filter);
+
+    CanFrame a = make_frame(0x100, 0, 0, 0);
+    CanFrame b = make_frame(0x123, 0, 0, 0);
+    CanFrame c = make_frame(0x1ABCDEF, FrameFlag::Extended, 0, 0);
+    CanFrame frames[2];
+    base.inject(&a);
+    base.inject(&b);
+    assert(bus.read_frames(frames, 2) == 1 && frames[0].id == 0x123);
+
+    // a fully rejected batch does not end the drain early
+    base.inject(&a);
+    base.inject(&a);
+    assert(bus.read_frames(frames, 2) == 0);
+    assert(!base.interrupt());
+    base.inject(&a);
+    base.inject(&c);
+    assert(bus.read_frame(&frames[0]) == MessageState::MessageFetched);
+    assert(same_frame(frames[0], c));
+    assert(filter.accepted() == 2 && filter.rejected() == 4);
+    printf("[OK] software filter\n");
+}
+
+static void test_send() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Sent sent = {};
+    base.set_transmit_hook(record, &sent);
+    start(base, bus);
+
+    uint8_t buf[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    assert(bus.send_buffer(0x15, 8, buf) == Result::OK);
+    assert(sent.count == 1 && sent.frames[0].id == 0x15 && sent.frames[0].data[7] == 8);
+
+    CanFrame ext = make_frame(0x1FFFFFFF, FrameFlag::Extended, 2, 9);
+    assert(bus.try_send(&ext, 0) == Result::OK);
+    assert(sent.count == 2 && same_frame(sent.frames[1], ext));
+
+    // each buffer is started by its own RTS bit
+    base.set_auto_transmit(false);
+    for (uint8_t i = 0; i < Limit::TXBuffers; ++i) {
+        CanFrame frame = make_frame(0x30 + i, 0, 1, i);
+        assert(bus.try_send(&frame, 0) == Result::OK);
+    }
+    assert(base.peek(Register::TXB0CTRL) & TXControlMask::RequestInProcess);
+    assert(base.peek(Register::TXB1CTRL) & TXControlMask::RequestInProcess);
+    assert(base.peek(Register::TXB2CTRL) & TXControlMask::RequestInProcess);
+    while (base.transmit()) {}
+    assert(sent.count == 5);
+    for (uint8_t i = 2; i < 5; ++i) {
+        assert(sent.frames[i].id >= 0x30 && sent.frames[i].id <= 0x32);
+    }
+
+    // a stuck bus times out instead of hanging
+    assert(bus.send_buffer(0x15, 8, buf) == Result::SendTimedOut);
+    printf("[OK] send\n");
+}
+
+struct Completions {
+    uint16_t tags[16];
+    uint8_t results[16];
+    uint8_t count;
+};
+
+static void completed(void *context, uint16_t tag, uint8_t result) {
+    Completions *done = static_cast<Completions *>(context);
+    done->tags[done->count] = tag;
+    done->results[done->count] = result;
+    ++done->count;
+}
+
+static void drain_transmit(MCP2515 &bus, sim::MCP2515 &base) {
+    while (bus.pending_transmit()) {
+        if (!base.transmit()) {
+            assert(!base.interrupt());
+        }
+        if (base.interrupt()) {
+            bus.service_transmit();
+        }
+    }
+}
+
+static void test_transmit_queue() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Sent sent = {};
+    Completions done = {};
+    TransmitEntry entries[8];
+    base.set_transmit_hook(record, &sent);
+    base.set_auto_transmit(false);
+    start(base, bus);
+    bus.set_transmit_queue(entries, 8, completed, &done);
+    assert(base.peek(Register::InterruptEnable) & InterruptMask::TXAll);
+
+    // three frames go straight into TXB0-TXB2, eight wait in the queue
+    for (uint16_t i = 0; i < 11; ++i) {
+        CanFrame frame = make_frame(0x200 + i, 0, 1, i);
+        assert(bus.queue_send(&frame, i) == Result::OK);
+    }
+    CanFrame extra = make_frame(0x300, 0, 0, 0);
+    assert(bus.queue_send(&extra, 99) == Result::QueueFull);
+
+    // a drained buffer is refilled at once, with a lower TXP than the
+    // frames still in flight
+    assert(base.transmit() == 1);
+    bus.service_transmit();
+    assert(base.peek(Register::TXB2CTRL) & TXControlMask::RequestInProcess);
+    assert((base.peek(Register::TXB2CTRL) & TXControlMask::Priority) <
+           (base.peek(Register::TXB0CTRL) & TXControlMask::Priority));
+    drain_transmit(bus, base);
+    assert(done.count == 11 && sent.count == 11);
+    for (uint8_t i = 0; i < 11; ++i) {
+        assert(sent.frames[i].id == 0x200u + i);
+        assert(done.tags[i] == i && done.results[i] == Result::OK);
+    }
+    assert(!base.interrupt());
+
+    // a blocking send that timed out keeps its buffer until it leaves
+    done.count = 0;
+    sent.count = 0;
+    CanFrame stuck = make_frame(0x111, 0, 1, 0);
+    assert(bus.send_frame(&stuck) == Result::SendTimedOut);
+    for (uint16_t i = 0; i < 3; ++i) {
+        CanFrame frame = make_frame(0x200 + i, 0, 1, i);
+        assert(bus.queue_send(&frame, i) == Result::OK);
+    }
+    drain_transmit(bus, base);
+    while (base.transmit()) {}
+    if (base.interrupt()) {
+        bus.service_transmit();
+    }
+    assert(done.count == 3 && sent.count == 4);
+    bool stuckSent = false;
+    for (uint8_t i = 0; i < 4; ++i) {
+        stuckSent = stuckSent || same_frame(sent.frames[i], stuck);
+    }
+    assert(stuckSent);
+    assert(!base.interrupt());
+
+    // one that leaves before service_transmit() runs does not pass for
+    // the queued frame loaded into its buffer
+    done.count = 0;
+    assert(bus.send_frame(&stuck) == Result::SendTimedOut);
+    assert(base.transmit() == 1 && base.interrupt());
+    for (uint16_t i = 0; i < 3; ++i) {
+        CanFrame frame = make_frame(0x200 + i, 0, 1, i);
+        assert(bus.queue_send(&frame, i) == Result::OK);
+    }
+    bus.service_transmit();
+    assert(done.count == 0 && bus.pending_transmit() == 3 && !base.interrupt());
+    drain_transmit(bus, base);
+    assert(done.count == 3);
+    printf("[OK] transmit queue\n");
+}
+
+static void test_transmit_priority() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Sent sent = {};
+    Completions done = {};
+    TransmitEntry entries[8];
+    base.set_transmit_hook(record, &sent);
+    base.set_auto_transmit(false);
+    start(base, bus);
+    bus.set_transmit_queue(entries, 8, completed, &done);
+
+    // a high frame overtakes the queued low ones, low ones stay in order
+    for (uint16_t i = 0; i < 5; ++i) {
+        CanFrame frame = make_frame(0x400 + i, 0, 1, i);
+        assert(bus.queue_send(&frame, i) == Result::OK);
+    }
+    CanFrame high = make_frame(0x100, 0, 1, 0);
+    assert(bus.queue_send(&high, 10, TransmitPriority::High) == Result::OK);
+    CanFrame low = make_frame(0x500, 0, 0, 0);
+    assert(bus.try_send(&low, 11) == Result::AllBuffersBusy);
+    drain_transmit(bus, base);
+    static const uint16_t order[] = {0, 10, 1, 2, 3, 4};
+    assert(done.count == 6 && sent.count == 6);
+    for (uint8_t i = 0; i < 6; ++i) {
+        assert(done.tags[i] == order[i] && done.results[i] == Result::OK);
+    }
+
+    // an urgent frame aborts the last low one, which goes out again later
+    done.count = 0;
+    sent.count = 0;
+    for (uint16_t i = 0; i < 3; ++i) {
+        CanFrame frame = make_frame(0x400 + i, 0, 1, i);
+        assert(bus.queue_send(&frame, i) == Result::OK);
+    }
+    CanFrame urgent = make_frame(0x001, 0, 2, 7);
+    assert(bus.queue_send(&urgent, 20, TransmitPriority::Urgent) == Result::OK);
+    assert(done.count == 0 && bus.pending_transmit() == 4);
+    assert(base.peek(Register::TXB0CTRL) & TXControlMask::RequestInProcess);
+    assert((base.peek(Register::TXB0CTRL) & TXControlMask::Priority) == TransmitPriority::Urgent);
+    drain_transmit(bus, base);
+    assert(sent.count == 4 && same_frame(sent.frames[0], urgent));
+    static const uint16_t resent[] = {20, 0, 1, 2};
+    assert(done.count == 4);
+    for (uint8_t i = 0; i < 4; ++i) {
+        assert(done.tags[i] == resent[i] && done.results[i] == Result::OK);
+        assert(i == 0 || sent.frames[i].id == 0x400u + resent[i]);
+    }
+    printf("[OK] transmit priority\n");
+}
+
+static void test_deadlines() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Sent sent = {};
+    Completions done = {};
+    TransmitEntry entries[4];
+    base.set_transmit_hook(record, &sent);
+    base.set_auto_transmit(false);
+    start(base, bus);
+
+    // without a clock the deadline is ignored and the send times out
+    CanFrame frame = make_frame(0x20, 0, 1, 1);
+    SendOptions late = {0, 2000};
+    assert(bus.send_frame(&frame, &late) == Result::SendTimedOut);
+    while (base.transmit()) {}
+    sent.count = 0;
+
+    // a blocking send past its deadline is aborted
+    base.set_time(3000);
+    assert(bus.send_frame(&frame, &late) == Result::Expired);
+    assert(!(base.peek(Register::TXB0CTRL) & TXControlMask::RequestInProcess));
+    assert(!(base.peek(Register::TXB1CTRL) & TXControlMask::RequestInProcess));
+    assert(!(base.peek(Register::TXB2CTRL) & TXControlMask::RequestInProcess));
+
+    // queued and in-flight frames expire on the next service
+    bus.set_transmit_queue(entries, 4, completed, &done);
+    SendOptions soon = {0, 5000};
+    for (uint16_t i = 0; i < 4; ++i) {
+        assert(bus.queue_send(&frame, i, TransmitPriority::Low, &soon) == Result::OK);
+    }
+    CanFrame keep = make_frame(0x21, 0, 0, 0);
+    assert(bus.queue_send(&keep, 9) == Result::OK);
+    bus.service_transmit();
+    assert(done.count == 0);
+    base.set_time(6000);
+    bus.service_transmit();
+    assert(done.count == 4);
+    for (uint8_t i = 0; i < 4; ++i) {
+        assert(done.results[i] == Result::Expired);
+    }
+    drain_transmit(bus, base);
+    assert(done.count == 5 && done.tags[4] == 9 && done.results[4] == Result::OK);
+    assert(sent.count == 1 && sent.frames[0].id == 0x21);
+
+    // one-shot frames are not retried, regular ones are
+    SendOptions once = {SendFlag::OneShot, 0};
+    base.set_auto_transmit(true);
+    base.fail_transmissions(1);
+    assert(bus.send_frame(&frame, &once) == Result::SendAborted);
+    assert(base.peek(Register::Control) & Mode::OneShot);
+    done.count = 0;
+    base.fail_transmissions(1);
+    assert(bus.queue_send(&frame, 1, TransmitPriority::Low, &once) == Result::OK);
+    bus.service_transmit();
+    assert(done.count == 1 && done.results[0] == Result::SendAborted);
+    base.set_auto_transmit(false);
+    base.fail_transmissions(1);
+    assert(bus.queue_send(&keep, 2) == Result::OK);
+    assert(!(base.peek(Register::Control) & Mode::OneShot));
+    drain_transmit(bus, base);
+    assert(done.count == 2 && done.results[1] == Result::OK);
+    printf("[OK] deadlines\n");
+}
+
+static void test_clock_wrap() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Completions done = {};
+    TransmitEntry entries[2];
+    base.set_auto_transmit(false);
+    start(base, bus);
+    bus.set_transmit_queue(entries, 2, completed, &done);
+
+    // the clock of a backend on a 32-bit microsecond counter, 256 us
+    // before it wraps
+    WideCounter micros;
+    base.set_time(micros.extend(0xFFFFFF00) * 1000ull);
+    SendOptions soon = {0, base.now() + 1000000};
+    CanFrame frame = make_frame(0x40, 0, 0, 0);
+    assert(bus.queue_send(&frame, 1, TransmitPriority::Low, &soon) == Result::OK);
+
+    // 512 us in, past the wrap, the deadline is still ahead
+    base.set_time(micros.extend(0x100) * 1000ull);
+    bus.service_transmit();
+    assert(done.count == 0);
+    // 1280 us in it has passed
+    base.set_time(micros.extend(0x400) * 1000ull);
+    bus.service_transmit();
+    assert(done.count == 1 && done.results[0] == Result::Expired);
+    assert(micros.extend(0x400) == 0x100000400ull);
+    printf("[OK] clock wrap\n");
+}
+
+struct StateLog {
+    uint8_t states[16];
+    uint8_t rec[16];
+    uint8_t count;
+};
+
+static void state_changed(void *context, uint8_t state, const BusErrors *errors) {
+    StateLog *log = static_cast<StateLog *>(context);
+    assert(errors->state == state);
+    log->states[log->count] = state;
+    log->rec[log->count] = errors->rec;
+    ++log->count;
+}
+
+static void test_bus_errors() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    StateLog log = {};
+    Completions done = {};
+    TransmitEntry entries[4];
+    base.set_auto_transmit(false);
+    base.set_time(1);
+    RecoveryPolicy policy = {Recovery::Restart, 1000, 8000, 0};
+    bus.set_error_handler(state_changed, &log, &policy);
+    start(base, bus);
+    assert(base.peek(Register::InterruptEnable) & InterruptFlag::Error);
+    bus.set_transmit_queue(entries, 4, completed, &done);
+    assert(bus.set_filter(0, 0x123) == Result::OK);
+
+    // nothing to do while ERRIF is clear
+    assert(bus.service_errors() == BusState::ErrorActive && log.count == 0);
+    base.receive_errors(96);
+    assert(base.interrupt());
+    assert(bus.service_errors() == BusState::ErrorWarning);
+    assert(!base.interrupt() && bus.bus_errors().rec == 96);
+    base.receive_errors(32);
+    assert(bus.service_errors() == BusState::ErrorPassive);
+
+    // 32 failed attempts take TEC to 256
+    CanFrame frame = make_frame(0x40, 0, 1, 1);
+    assert(bus.queue_send(&frame, 5) == Result::OK);
+    base.fail_transmissions(32);
+    for (uint8_t i = 0; i < 32; ++i) {
+        base.transmit();
+    }
+    assert(bus.service_errors() == BusState::BusOff);
+    assert(bus.bus_errors().busOffs == 1);
+    base.set_time(500);
+    assert(bus.service_errors() == BusState::BusOff);
+
+    // the restart restores the configuration and the frame in flight
+    base.set_time(1001);
+    assert(bus.service_errors() == BusState::ErrorActive);
+    assert(bus.bus_errors().restarts == 1 && bus.verify() == Result::OK);
+    assert(base.mode() == Mode::Normal);
+    assert(base.peek(Register::TXB2CTRL) & TXControlMask::RequestInProcess);
+    static const uint8_t expected[] = {
+        BusState::ErrorWarning, BusState::ErrorPassive,
+        BusState::BusOff, BusState::ErrorActive,
+    };
+    assert(log.count == 4);
+    for (uint8_t i = 0; i < 4; ++i) {
+        assert(log.states[i] == expected[i]);
+    }
+    assert(log.rec[0] == 96 && log.rec[1] == 128);
+
+    // another bus-off right after the restart waits twice as long
+    base.fail_transmissions(32);
+    for (uint8_t i = 0; i < 32; ++i) {
+        base.transmit();
+    }
+    assert(bus.service_errors() == BusState::BusOff);
+    base.set_time(2002);
+    assert(bus.service_errors() == BusState::BusOff);
+    base.set_time(3001);
+    assert(bus.service_errors() == BusState::ErrorActive);
+    assert(bus.bus_errors().restarts == 2 && done.count == 0);
+    assert(base.transmit() == 1);
+    bus.service_transmit();
+    assert(done.count == 1 && done.tags[0] == 5 && done.results[0] == Result::OK);
+
+    // receive overflows are counted and cleared
+    CanFrame in = make_frame(0x123, 0, 0, 0);
+    for (uint8_t i = 0; i < 3; ++i) {
+        base.inject(&in);
+    }
+    bus.service_errors();
+    assert(bus.bus_errors().rxOverflows == 1);
+    assert(!(base.peek(Register::ErrorFlag) & ErrorMask::RXOverflow));
+    printf("[OK] bus errors\n");
+}
+
+static void test_stats() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Completions done = {};
+    TransmitEntry entries[4];
+    base.set_time(1000);
+    start(base, bus);
+
+    CanFrame frame = make_frame(0x30, 0, 2, 3);
+    CanFrame out;
+    base.inject(&frame);
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(bus.send_frame(&frame) == Result::OK);
+    base.set_auto_transmit(false);
+    bus.set_transmit_queue(entries, 4, completed, &done);
+    assert(bus.queue_send(&frame, 1) == Result::OK);
+    base.set_time(6000);
+    base.transmit();
+    bus.service_transmit();
+    SendOptions late = {0, 7000};
+    base.set_time(8000);
+    assert(bus.send_frame(&frame, &late) == Result::Expired);
+
+    DriverStats stats;
+    bus.stats(&stats);
+#if MCP2515_STATS
+    assert(stats.framesReceived == 1 && stats.framesSent == 2);
+    assert(stats.timeouts == 1 && stats.txBusyWaits >= 1);
+    // the blocking send completed at once, the queued one after 5 us,
+    // which lands in [4, 8) us
+    assert(stats.sendToComplete.samples == 2 && stats.sendToComplete.max == 5000);
+    assert(stats.sendToComplete.buckets[0] == 1 && stats.sendToComplete.buckets[3] == 1);
+    bus.clear_stats();
+    bus.stats(&stats);
+#endif
+    assert(stats.framesReceived == 0 && stats.framesSent == 0);
+    assert(stats.sendToComplete.samples == 0);
+    printf("[OK] stats\n");
+}
+
+static void test_static_dispatch() {
+    sim::MCP2515 base;
+    BasicMCP2515<sim::MCP2515> bus(&base);
+    Sent sent = {};
+    base.set_transmit_hook(record, &sent);
+    assert(bus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+
+    CanFrame in = make_frame(0x1ABCDEF, FrameFlag::Extended, 8, 0x20);
+    CanFrame out;
+    base.inject(&in);
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(same_frame(in, out));
+    assert(bus.try_send(&in, 0) == Result::OK);
+    assert(sent.count == 1 && same_frame(sent.frames[0], in));
+    printf("[OK] static dispatch\n");
+}
+
+static void test_sessions() {
+    sim::MCP2515 base;
+    sim::Counter counter(&base);
+    MCP2515 bus(&counter);
+    counter.clear();
+    assert(bus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    // reset, two mode changes and the configuration batch share the bus
+    assert(counter.counts().transactions > 4 && counter.counts().acquires == 1);
+
+    CanFrame in = make_frame(0x123, 0, 2, 1);
+    CanFrame out;
+    base.inject(&in);
+    counter.clear();
+    assert(bus.read_frame(&out) == MessageState::MessageFetched);
+    assert(counter.counts().calls == 2 && counter.counts().acquires == 1);
+
+    counter.clear();
+    assert(bus.get_message_status() == MessageState::NoMessage);
+    assert(counter.counts().acquires == 1);
+
+    // timestamps come from the wrapped backend, not the default of 0
+    FrameInfo info;
+    base.set_time(3000);
+    base.inject(&in);
+    assert(bus.read_frames(&out, 1, &info) == 1 && info.timestamp == 3000);
+    printf("[OK] sessions\n");
+}
+
+static void test_abort() {
+    sim::MCP2515 base;
+    MCP2515 bus(&base);
+    Completions done = {};
+    TransmitEntry entries[4];
+    base.set_auto_transmit(false);
+    start(base, bus);
+    bus.set_transmit_queue(entries, 4, completed, &done);
+
+    CanFrame frame = make_frame(0x10, 0, 0, 0);
+    assert(bus.queue_send(&frame, 7) == Result::OK);
+    base.modify_register(Register::Control, 0x10, 0x10);
+    base.modify_register(Register::Control, 0x10, 0x00);
+    bus.service_transmit();
+    assert(done.count == 1 && done.tags[0] == 7);
+    assert(done.results[0] == Result::SendAborted);
+    printf("[OK] abort\n");
+}
+
+static void test_replay() {
+    linux::CaptureRecord records[64] = {};
+    for (uint32_t i = 0; i < 64; ++i) {
+        records[i].timestamp = 5000 + i * 1000;
+        records[i].sequence = i;
+        records[i].id = 0x100 + i;
+        records[i].dlc = 1;
+        records[i].data[0] = (uint8_t) i;
+    }
+
+    // as fast as the driver drains, nothing lost
+    sim::MCP2515 chip;
+    sim::Replay replay(&chip);
+    BasicMCP2515<sim::Replay> bus(&replay);
+    assert(bus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    replay.load(records, records + 64);
+    replay.set_timing(sim::ReplayTiming::MaxSpeed);
+    CanFrame frames[2];
+    FrameInfo info[2];
+    uint32_t next = 0;
+    while (!replay.done()) {
+        uint8_t n = bus.read_frames(frames, 2, info);
+        for (uint8_t i = 0; i < n; ++i, ++next) {
+            assert(frames[i].id == 0x100 + next && frames[i].data[0] == next);
+            assert(info[i].timestamp == records[next].timestamp);
+        }
+    }
+    assert(next == 64);
+    assert(replay.stats().received == 64 && replay.stats().lost == 0);
+    assert(replay.throughput() > 0);
+
+    // a burst captured back to back arrives in one poll and, without
+    // rollover, only the first frame finds room
+    for (uint8_t i = 0; i < 3; ++i) {
+        records[i].timestamp = 0;
+    }
+    sim::MCP2515 burstChip;
+    sim::Replay burst(&burstChip);
+    BasicMCP2515<sim::Replay> burstBus(&burst);
+    assert(burstBus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    burst.load(records, records + 3);
+    burst.set_timing(sim::ReplayTiming::Original);
+    assert(burstBus.read_frames(frames, 2) == 1 && frames[0].id == 0x100);
+    assert(burst.done());
+    assert(burst.stats().received == 1 && burst.stats().lost == 2);
+
+    // with rollover one poll fills both buffers, and each frame keeps its
+    // own captured timestamp
+    sim::MCP2515 pairChip;
+    sim::Replay pair(&pairChip);
+    BasicMCP2515<sim::Replay> pairBus(&pair);
+    assert(pairBus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    pairChip.modify_register(
+        Register::RXB0CTRL,
+        RXControlMask::AcceptBUKT,
+        RXControlMask::AcceptBUKT);
+    pair.load(records + 10, records + 12);
+    pair.set_timing(sim::ReplayTiming::MaxSpeed);
+    assert(pairBus.read_frames(frames, 2, info) == 2);
+    assert(info[0].timestamp == records[10].timestamp);
+    assert(info[1].timestamp == records[11].timestamp);
+    printf("[OK] replay\n");
+}
+
+struct Delivered {
+    uint8_t controller[32];
+    uint32_t id[32];
+    uint32_t sequence[32];
+    uint8_t count;
+};
+
+static void deliver(
+        void *context, uint8_t controller,
+        const CanFrame frames[], const FrameInfo info[], uint8_t n) {
+    Delivered *d = static_cast<Delivered *>(context);
+    for (uint8_t i = 0; i < n && d->count < 32; ++i) {
+        d->controller[d->count] = controller;
+        d->id[d->count] = frames[i].id;
+        d->sequence[d->count] = info[i].sequence;
+        ++d->count;
+    }
+}
+
+static void test_reactor() {
+    linux::CaptureRecord records[16] = {};
+    for (uint32_t i = 0; i < 16; ++i) {
+        records[i].id = 0x200 + i;
+    }
+    // controller 0 refills as fast as it is drained, controller 1 has a
+    // single frame waiting
+    sim::MCP2515 busyChip;
+    sim::Replay busy(&busyChip);
+    busy.set_timing(sim::ReplayTiming::MaxSpeed);
+    MCP2515 busyBus(&busy);
+    sim::MCP2515 quietChip;
+    MCP2515 quietBus(&quietChip);
+    assert(busyBus.begin(CAN_500KBPS, MCP_8MHz) == Result::OK);
+    start(quietChip, quietBus);
+    busy.load(records, records + 16);
+    CanFrame frame = make_frame(0x300, 0, 0, 0);
+    quietChip.inject(&frame);
+
+    linux::EventInterrupt busyInt, quietInt;
+    assert(busyInt.open() == 0 && quietInt.open() == 0);
+    linux::MCP2515 busyBase("/dev/null", 0), quietBase("/dev/null", 0);
+    busyBase.set_interrupt_source(&busyInt);
+    quietBase.set_interrupt_source(&quietInt);
+
+    Delivered d = {{0}, {0}, {0}, 0};
+    linux::Reactor reactor(4);
+    assert(reactor.open() == 0);
+    assert(reactor.add(&busyBase, &busyBus, deliver, &d) == 0);
+    assert(reactor.add(&quietBase, &quietBus, deliver, &d) == 1);
+    busyInt.trigger();
+    quietInt.trigger();
+
+    // one round: the busy bus stops at its budget, the quiet one is served
+    assert(reactor.run_once(0) == 2);
+    assert(d.count == 5 && d.controller[4] == 1 && d.id[4] == 0x300);
+    // each controller numbers its own frames, oldest first
+    for (uint8_t i = 0; i < 4; ++i) {
+        assert(d.controller[i] == 0 && d.id[i] == 0x200u + i);
+        assert(i == 0 || d.sequence[i] == d.sequence[i - 1] + 1);
+    }
+    assert(reactor.stats(0).deferred == 1 && reactor.stats(1).received == 1);
+    // the busy bus is carried over without a new edge until it is empty
+    while (reactor.run_once(0) > 0) {
+    }
+    assert(reactor.stats(0).received == 16 && busy.done());
+
+    // a finished transmission is cleared on the turn, so the next frame
+    // still produces an edge
+    Completions done = {};
+    TransmitEntry entries[2];
+    quietBus.set_transmit_queue(entries, 2, completed, &done);
+    quietChip.set_auto_transmit(false);
+    assert(quietBus.queue_send(&frame, 1) == Result::OK);
+    assert(quietChip.transmit() == 1 && quietChip.interrupt());
+    quietInt.trigger();
+    assert(reactor.run_once(0) == 1);
+    assert(done.count == 1 && !quietChip.interrupt());
+    quietChip.inject(&frame);
+    quietInt.trigger();
+    assert(reactor.run_once(0) == 1);
+    assert(reactor.stats(1).received == 2);
+
+    // a refill that completes during the turn raises TXnIF again while INT
+    // is still low, the controller is carried over until it is quiet
+    TransmitEntry more[4];
+    done.count = 0;
+    quietBus.set_transmit_queue(more, 4, completed, &done);
+    quietChip.set_auto_transmit(true);
+    for (uint16_t i = 0; i < 4; ++i) {
+        assert(quietBus.queue_send(&frame, i) == Result::OK);
+    }
+    quietInt.trigger();
+    assert(reactor.run_once(0) == 1 && quietChip.interrupt());
+    while (reactor.run_once(0) > 0) {
+    }
+    assert(done.count == 4 && !quietChip.interrupt());
+
+    // a deadline expires on a quiet wait, without an edge
+    done.count = 0;
+    quietChip.set_auto_transmit(false);
+    quietChip.set_time(1000);
+    SendOptions soon = {0, 5000};
+    assert(quietBus.queue_send(&frame, 7, TransmitPriority::Low, &soon) == Result::OK);
+    assert(reactor.run_once(0) == 0 && done.count == 0);
+    quietChip.set_time(6000);
+    assert(reactor.run_once(0) == 0);
+    assert(done.count == 1 && done.results[0] == Result::Expired);
+    printf("[OK] reactor\n");
+}
+
+static void test_receiver_thread() {
+    sim::MCP2515 chip;
+    MCP2515 bus(&chip);
+    start(chip, bus);
+    CanFrame frame = make_frame(0x42, 0, 1, 7);
+    for (uint8_t i = 0; i < 3; ++i) {
+        chip.inject(&frame);
+    }
+
+    linux::EventInterrupt interrupt;
+    assert(interrupt.open() == 0);
+    linux::MCP2515 base("/dev/null", 0);
+    base.set_interrupt_source(&interrupt);
+
+    static CanFrame frames[16];
+    static FrameInfo info[16];
+    linux::Receiver receiver(&base, &bus, frames, 16, info);
+    linux::ThreadConfig config = {0, 0, 256 * 1024, false};
+    assert(receiver.start(100, &config) == 0);
+    interrupt.trigger();
+    for (int i = 0; i < 1000 && 0 == receiver.wake_latency().samples; ++i) {
+        usleep(1000);
+    }
+    receiver.stop();
+
+    CanFrame out;
+    FrameInfo outInfo;
+    assert(receiver.pop(&out, &outInfo) && same_frame(out, frame));
+    // the third frame found both buffers full, ERRIF is released
+    assert(receiver.overruns() == 1);
+    assert(!(chip.peek(Register::InterruptFlag) & InterruptFlag::Error));
+    linux::WakeLatency latency = receiver.wake_latency();
+    assert(latency.samples == 1 && latency.min == latency.max);
+    printf("[OK] receiver thread\n");
+}
+
+int main(void) {
+    test_begin();
+    test_receive();
+    test_rollover_and_overflow();
+    test_read_frames();
+    test_frame_info();
+    test_filters();
+    test_acceptance();
+    test_software_filter();
+    test_send();
+    test_transmit_queue();
+    test_transmit_priority();
+    test_deadlines();
+    test_clock_wrap();
+    test_bus_errors();
+    test_stats();
+    test_abort();
+    test_static_dispatch();
+    test_sessions();
+    test_replay();
+    test_reactor();
+    test_receiver_thread();
+    printf("All tests passed\n");
+}